@@ -19,9 +19,15 @@ typedef enum {false = 0, true = 1} bool;
 #define NULL ((void*)0)
 #endif
 
-#define NCPU 2
+// 最多支持的hart数量, 实际启动的hart数量由Makefile中的CPUNUM(qemu -smp)决定
+// hartid不小于NCPU的hart在entry.S中停住, 不参与调度
+#ifndef NCPU
+#define NCPU 8
+#endif
 #define PGSIZE 4096
 
-#define NPROC 64
+// 同时存在的进程(线程)数上限: 进程描述符按需申请, 这个值只决定内核栈槽和线程trapframe槽的数量
+// 实际能创建多少进程还受内核物理页数量的限制
+#define NPROC 1024
 #define BLOCK_SIZE 1024
 #endif
\ No newline at end of file
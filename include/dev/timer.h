@@ -4,21 +4,33 @@
 #include "lib/lock.h"
 
 // 计时器
+// tick直接由mtime换算, 所有hart都停掉周期时钟时仍然准确
 typedef struct timer {
-    uint64 ticks;
-    spinlock_t lk;
+    uint64 base;   // 开机时的mtime, tick从这里开始计数
 } timer_t;
 
 // 每隔INTERVAL个单位时间发生一次时钟中断(1e6大约为0.1s)
 #define INTERVAL 1000000
 
-// 时间片长度（单位：timer ticks）
-#define TIME_SLICE 10
+// CLINT的mtime计数频率(qemu virt为10MHz)
+#define TIMER_FREQ 10000000
+// 一个tick的纳秒数, 以及纳秒到tick的换算(向上取整)
+#define TICK_NS ((uint64)INTERVAL * 1000000000ul / TIMER_FREQ)
+#define NS_TO_TICKS(ns) (((uint64)(ns) + TICK_NS - 1) / TICK_NS)
+
+// 最高优先级层的时间片长度（单位：timer ticks）, 每低一层翻倍(见proc/sched.h)
+#define TIME_SLICE 2
 
 void   timer_init();       // 时钟初始化(in M-mode)
 
+// 停掉周期时钟时表示不设下一次中断
+#define TIMER_NEVER (~0ul)
+
 void   timer_create();     // 时钟创建
-void   timer_update();     // 时钟更新(ticks++)
+void   timer_update();     // 时钟更新(推进时间轮)
 uint64 timer_get_ticks();  // 获取时钟的tick
+bool   timer_tick_pending();            // 取走当前hart的时钟中断标志
+void   timer_tick_stop(uint64 deadline); // 停掉当前hart的周期时钟, 只在deadline(tick)时中断一次
+void   timer_tick_start();              // 恢复当前hart的周期时钟
 
 #endif
\ No newline at end of file
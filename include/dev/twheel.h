@@ -0,0 +1,46 @@
+#ifndef __TWHEEL_H__
+#define __TWHEEL_H__
+
+#include "common.h"
+
+/*
+    分层时间轮: 定时事件按到期tick挂在TW_LEVELS层、每层TW_SIZE个槽的链表上
+    第0层每槽1个tick, 第l层每槽TW_SIZE^l个tick
+    时钟每走过一圈第0层, 就把上一层当前槽里的事件重新分配到下面的层(级联)
+    添加和取消都是O(1), 每个tick只处理一个槽, 没有到期的事件不产生任何开销
+
+    时钟由CPU 0的timer_update推进, 回调在时钟中断里执行(不持有时间轮的锁):
+    回调不能睡眠, 但可以重新添加定时事件
+    armed在回调开始之前就被清除, 事件的主人此后可能随时释放它, 回调参数不能依赖事件本身
+    纳秒时长用dev/timer.h的NS_TO_TICKS换算成tick
+
+    CPU 0空闲时停掉周期时钟, 只在下一个事件可能到期的tick醒来(twheel_idle)
+    期间添加了更早到期的事件时用处理器间中断把它叫醒
+*/
+
+#define TW_BITS   6
+#define TW_SIZE   (1 << TW_BITS)
+#define TW_MASK   (TW_SIZE - 1)
+#define TW_LEVELS 3  // 最远约TW_SIZE^3个tick, 更远的事件到时再级联
+
+typedef struct twheel_event {
+    uint64 expires;                 // 到期的绝对tick
+    void (*func)(void* arg);        // 到期回调
+    void* arg;
+    bool armed;                     // 是否挂在时间轮上(尚未到期也未取消)
+    struct twheel_event* next;
+    struct twheel_event* prev;
+    struct twheel_event** slot;     // 所在链表的头指针
+} twheel_event_t;
+
+void twheel_init();                                                      // 时间轮初始化
+void twheel_event_init(twheel_event_t* ev, void (*func)(void*), void* arg); // 设置回调
+void twheel_add(twheel_event_t* ev, uint64 expires);                     // 在绝对tick到期(已挂上时改为新时间)
+void twheel_add_after(twheel_event_t* ev, uint64 delta);                 // delta个tick之后到期
+bool twheel_cancel(twheel_event_t* ev);                                  // 取消, 回调已经开始执行时返回false
+void twheel_run(uint64 now);                                             // 推进到now并执行到期回调
+void twheel_sleep(uint64 ticks);                                         // 当前进程睡眠ticks个tick
+uint64 twheel_idle();                                                    // CPU 0进入空闲, 返回需要醒来的tick
+void twheel_idle_end();                                                  // CPU 0恢复周期时钟
+
+#endif
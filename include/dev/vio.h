@@ -8,5 +8,6 @@ typedef struct buf buf_t;
 void virtio_disk_init();
 void virtio_disk_intr();
 void virtio_disk_rw(buf_t *b, bool write);
+void virtio_disk_rw_page(uint32 block_num, uint64 pa, bool write);
 
 #endif
@@ -18,6 +18,9 @@ typedef struct super_block
     unsigned int data_blocks;
     unsigned int total_blocks;
 
+    unsigned int swap_start;    // 交换区起始block (位于数据区之后)
+    unsigned int swap_blocks;   // 交换区block数量 (0表示没有交换区)
+
 } super_block_t;
 
 void fs_init();
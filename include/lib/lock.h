@@ -16,4 +16,19 @@ void spinlock_init(spinlock_t* lk, char* name);
 void spinlock_acquire(spinlock_t* lk);
 void spinlock_release(spinlock_t* lk);
 bool spinlock_holding(spinlock_t* lk); 
+bool spinlock_try_acquire(spinlock_t* lk);
+
+// 睡眠锁: 等待者睡眠而不是自旋, 持有期间可以睡眠(如读写磁盘)
+// 只能在进程上下文中使用, 持有自旋锁时不能获取
+typedef struct sleeplock {
+    bool locked;
+    spinlock_t lk;   // 保护下面的字段
+    char* name;
+    int pid;         // 持有者的pid
+} sleeplock_t;
+
+void sleeplock_init(sleeplock_t* lk, char* name);
+void sleeplock_acquire(sleeplock_t* lk);
+void sleeplock_release(sleeplock_t* lk);
+bool sleeplock_holding(sleeplock_t* lk);
 #endif
\ No newline at end of file
@@ -0,0 +1,25 @@
+#ifndef __LZ_H__
+#define __LZ_H__
+
+#include "common.h"
+
+/*
+    LZ77族的字节流压缩(格式与LZ4 block类似)
+    每个序列: token(高4位字面量长度, 低4位匹配长度-4) + 扩展长度 + 字面量
+              + 2字节小端offset + 匹配长度扩展
+    长度字段为15时后面跟扩展字节, 每个255表示继续
+    最后一个序列只有字面量, 没有offset
+*/
+
+#define LZ_MIN_MATCH  4
+#define LZ_HASH_BITS  10
+#define LZ_HASH_SIZE  (1 << LZ_HASH_BITS)
+
+// 压缩src[0, len), 结果写入dst, 超过cap字节时放弃并返回0
+// table是调用者提供的LZ_HASH_SIZE项工作区(避免占用内核栈), len不超过65535
+uint32 lz_compress(const uint8* src, uint32 len, uint8* dst, uint32 cap, uint16* table);
+
+// 解压src[0, clen)到dst, 返回解压后的长度, 数据损坏或超过cap时返回0
+uint32 lz_decompress(const uint8* src, uint32 clen, uint8* dst, uint32 cap);
+
+#endif
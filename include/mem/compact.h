@@ -0,0 +1,38 @@
+#ifndef __COMPACT_H__
+#define __COMPACT_H__
+
+#include "common.h"
+
+/*
+    物理内存规整
+    挑选一个2MiB对齐、已用页面最少且全部可迁移的块, 把其中的页面迁移到块外的空闲页
+    (迁移目标从user_region高地址端往下找), 通过反向映射改写所有PTE并刷新TLB
+    腾空的块可以直接被pmem_alloc_huge分配
+
+    碎片指数(千分制, 参考Linux的extfrag index):
+    1000 - (1000 + 空闲页数 * 1000 / HUGE_PAGES) / 空闲区段数
+    越接近1000说明大块分配失败是因为碎片, 越接近0说明是因为内存不足
+    已经存在空闲的对齐块时为-1
+*/
+
+#define COMPACT_DEFER_MAX     6     // 规整失败后最多推迟2^6次请求
+#define COMPACT_INTERVAL      50    // 后台规整的间隔(时钟tick)
+#define COMPACT_PROACTIVE     500   // 碎片指数超过它时后台规整
+
+// 最近一次规整的统计信息
+typedef struct compact_stat {
+    int    frag_before;   // 规整前的碎片指数
+    int    frag_after;    // 规整后的碎片指数
+    uint32 migrated;      // 累计迁移的页面数
+    uint32 succeeded;     // 累计腾空的块数
+    uint32 failed;        // 累计失败次数
+} compact_stat_t;
+
+void compact_init();
+int  compact_frag_index();          // 当前的碎片指数
+bool compact_huge();                // 腾出一个空闲的2MiB对齐块
+bool compact_try_huge();            // 大页分配失败时调用, 失败后按指数退避推迟
+void compact_daemon(void* arg);     // kcompactd内核线程, 碎片严重时主动规整
+void compact_get_stat(compact_stat_t* st);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef __KCACHE_H__
+#define __KCACHE_H__
+
+#include "common.h"
+#include "lib/lock.h"
+
+/*
+    固定大小的内核对象缓存
+    需要对象时从内核物理页中切出一整页, 按对象大小分成若干个对象挂进空闲链
+    申请和释放都只是在空闲链头部摘下或放回一个对象, 代价是O(1)
+    释放的对象留在空闲链里等待复用, 切出去的页面不再归还
+    空闲对象的前8个字节被用作链表指针, 申请者必须重新初始化对象的全部字段
+*/
+typedef struct kcache {
+    spinlock_t lk;        // 保护下面的字段
+    char* name;
+    uint32 size;          // 对象大小(8字节对齐)
+    void* free;           // 空闲对象链
+    uint32 total;         // 已经切出的对象数
+    uint32 nfree;         // 空闲链中的对象数
+} kcache_t;
+
+void  kcache_init(kcache_t* c, char* name, uint32 size);
+void* kcache_alloc(kcache_t* c);          // 申请一个对象, 内存不足返回NULL
+void  kcache_free(kcache_t* c, void* obj);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef __KSM_H__
+#define __KSM_H__
+
+#include "common.h"
+
+/*
+    同页合并(kernel same-page merging)
+    后台扫描器按物理页顺序循环扫描user_region, 计算每个私有页面的内容校验和
+    两轮扫描之间校验和没有变化的页面才是合并候选(避免反复合并正在被写的页面)
+
+    稳定表: 已经被共享的页面(PG_KSM), 候选页面内容相同时直接合并进去
+    不稳定表: 内容暂时稳定的私有页面, 找到内容相同的另一个私有页面时
+              把它提升为共享页面并加入稳定表, 每完成一轮全表扫描清空一次
+
+    被合并的PTE指向共享页面, 清除写权限并打上PTE_COW, 写入时再复制
+*/
+
+#define KSM_SCAN_PAGES  32    // 每次扫描的页面数
+#define KSM_SCAN_TICKS  10    // 两次扫描之间间隔的时钟tick(限速)
+#define KSM_TABLE_SIZE  1024  // 稳定表和不稳定表的大小
+#define KSM_PROBE       8     // 查找和插入时最多探测的表项数
+
+// 同页合并的统计信息
+typedef struct ksm_stat {
+    uint64 pages_shared;    // 当前被共享的页面数
+    uint64 pages_sharing;   // 指向共享页面的额外映射数(即节省的页面数)
+    uint64 pages_scanned;   // 累计扫描的页面数
+    uint64 full_scans;      // 完成的全表扫描轮数
+} ksm_stat_t;
+
+void ksm_init();
+void ksm_scan();                     // 扫描下一批页面
+void ksm_daemon(void* arg);          // ksmd内核线程, 每KSM_SCAN_TICKS个tick扫描一次
+void ksm_get_stat(ksm_stat_t* st);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef __KSTACK_H__
+#define __KSTACK_H__
+
+#include "common.h"
+
+/*
+    进程内核栈
+    每个进程独占一个内核栈, 由KSTACK_PAGES个内核物理页组成, 映射在内核页表的KSTACK区域
+    内核栈区域被划分为若干个槽, 每个槽是 1个保护页 + KSTACK_PAGES个栈页
+    保护页永远不映射, 栈溢出时触发缺页异常而不是悄悄改写相邻的栈
+
+    进程释放时内核栈先进入缓存(保持映射), 新进程优先复用缓存里的栈
+    缓存满了才解除映射并归还物理页
+*/
+
+#define KSTACK_PAGES 2                          // 每个内核栈的页数
+#define KSTACK_SIZE  (KSTACK_PAGES * PGSIZE)    // 每个内核栈的大小
+#define KSTACK_SLOTS NPROC                      // 内核栈槽的数量
+#define KSTACK_CACHE 8                          // 缓存的空闲内核栈数量上限
+
+void   kstack_init();
+uint64 kstack_alloc();               // 申请一个内核栈, 返回栈底(最低地址), 失败返回0
+void   kstack_free(uint64 kstack);   // 释放内核栈
+int    kstack_slot(uint64 kstack);   // 内核栈所在的槽号, 在[0, KSTACK_SLOTS)之间且同时存在的栈互不相同
+
+#endif
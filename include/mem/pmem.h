@@ -2,10 +2,16 @@
 #define __PMEM_H__
 
 #include "common.h"
+#include "memlayout.h"
 #include "lib/lock.h"
 #include "lib/print.h"
 #include "lib/str.h"
+#include "mem/rmap.h"
 #define KERNEL_PAGES 2048
+// 用户区域最多包含的物理页数(可用内存128MB减去内核区域)
+#define USER_PAGES ((0x88000000ul - KERNEL_BASE) / PGSIZE - KERNEL_PAGES)
+// 2MiB大页由512个连续且2MiB对齐的物理页组成
+#define HUGE_PAGES 512
 // 来自kernel.ld
 extern char KERNEL_DATA[];
 extern char ALLOC_BEGIN[];
@@ -14,15 +20,38 @@ extern char ALLOC_END[];
 void  pmem_init(void);
 void* pmem_alloc(bool in_kernel);
 void  pmem_free(uint64 page, bool in_kernel);
-typedef struct page_node { 
-struct page_node* next;
- } page_node_t;
-typedef struct alloc_region { 
+void* pmem_alloc_huge(void);
+void  pmem_free_huge(uint64 page);
+void  pmem_get(uint64 page);
+bool  pmem_tryget(uint64 page);
+bool  pmem_take(uint64 page);
+bool  pmem_share(uint64 page);
+bool  pmem_unshare(uint64 page);
+// 空闲页链表(双向链表,便于从中间摘除页面)
+typedef struct page_node {
+    struct page_node* next;
+    struct page_node* prev;
+} page_node_t;
+typedef struct alloc_region {
 uint64 begin; // 起始物理地址
  uint64 end; // 终止物理地址
  spinlock_t lk; // 自旋锁(保护下面两个变量)
  uint32 allocable; // 可分配页面数
- page_node_t list_head; // 可分配链的链头节点 
-} alloc_region_t; 
-extern alloc_region_t kern_region, user_region; 
-#endif
\ No newline at end of file
+ page_node_t list_head; // 可分配链的链头节点
+} alloc_region_t;
+extern alloc_region_t kern_region, user_region;
+
+// 物理页描述符(只为user_region里的页面维护)
+typedef struct page {
+    uint8  flags;    // PG_xxx
+    uint8  age;      // 空闲年龄: 连续多少个采样周期没有被访问(见wss.h)
+    uint16 ref;      // 映射这个页面的PTE数量(同页合并后大于1)
+    uint32 hash;     // 同页合并扫描时记录的内容校验和
+    rmap_t rmap;     // 反向映射: 映射这个页面的(pgtbl, va)
+} page_t;
+
+#define PG_FREE (1 << 0) // 页面位于空闲链中
+#define PG_KSM  (1 << 1) // 页面被同页合并共享(只读, 写时复制)
+
+page_t* pmem_page(uint64 pa); // pa对应的页描述符, 不属于user_region返回NULL
+#endif
@@ -0,0 +1,32 @@
+#ifndef __RMAP_H__
+#define __RMAP_H__
+
+#include "common.h"
+#include "mem/vmem.h"
+
+/*
+    反向映射(rmap): 记录每个用户物理页被哪些(pgtbl, va)映射
+    第一个映射内联在页描述符中(绝大多数页面只有一个映射者)
+    其余映射挂在它的next链上, 节点从内核页中切分
+
+    vm_mappages/vm_unmappages以及uvm中直接改写PTE的路径负责维护
+    回收/合并/迁移页面时据此在O(映射者数量)内找到所有PTE
+*/
+
+typedef struct rmap {
+    pgtbl_t pgtbl;       // 映射者的顶级页表, NULL表示空
+    uint64 va;           // 映射的虚拟地址(4KiB对齐)
+    struct rmap* next;   // 其他映射者
+} rmap_t;
+
+void   rmap_init();
+void   rmap_add(uint64 pa, pgtbl_t pgtbl, uint64 va);      // 记录一个映射
+void   rmap_remove(uint64 pa, pgtbl_t pgtbl, uint64 va);   // 撤销一个映射
+pte_t* rmap_private_pte(uint64 pa);                        // 唯一的4KiB映射的PTE
+bool   rmap_movable(uint64 pa);                            // pa能否被迁移
+bool   rmap_move(uint64 src, uint64 dst);                  // 把src连同所有映射迁移到dst
+bool   rmap_merge(uint64 pa, uint64 kpa);                  // 私有页面的映射改指向共享页面
+bool   rmap_referenced(uint64 pa);                         // 检查并清除所有映射的A位
+uint32 rmap_unmap_all(uint64 pa, pte_t pte);               // 解除pa的所有映射
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __SWAP_H__
+#define __SWAP_H__
+
+#include "common.h"
+#include "mem/vmem.h"
+
+/*
+    交换区位于磁盘数据区之后, 由mkfs预留(super_block里的swap_start/swap_blocks)
+    交换区被划分为若干个槽, 每个槽存放一个换出的页面
+
+    页面被换出后, 它的PTE变成交换项:
+    PPN(44) + RSW(2)          + D A G U X W R V
+    槽号      SWAP=1 保留原COW    保留原U X W R   V=0
+    同页合并共享的页面换出时, 所有映射者的PTE指向同一个槽(槽带有引用计数)
+    V=0使得硬件访问时触发缺页, 缺页处理根据槽号把页面读回
+*/
+
+#define SWAP_BLOCKS_PER_PAGE (PGSIZE / BLOCK_SIZE) // 每个槽占用的block数
+#define SWAP_SLOTS_MAX       4096                  // 交换槽数量上限(16MB)
+#define SWAP_BATCH           8                     // 每次回收最多换出的页面数
+
+#define PTE_IS_SWAP(pte)      (!((pte) & PTE_V) && ((pte) & PTE_SWAP))
+#define PTE_TO_SWAP(pte)      ((uint32)((pte) >> 10))
+#define SWAP_TO_PTE(slot, pte) (((uint64)(slot) << 10) | PTE_SWAP | \
+                               ((pte) & (PTE_R | PTE_W | PTE_X | PTE_U | PTE_COW)))
+
+void   swap_init();                            // 读取交换区信息(在fs_init之后调用)
+uint32 swap_reclaim(uint32 npages);            // 回收冷页面, 返回换出的页面数
+bool   swap_in(pgtbl_t pgtbl, uint64 va);      // 把va所在的被换出页面读回
+void   swap_free(pte_t pte);                   // 释放交换项占用的槽
+
+#endif
@@ -57,6 +57,8 @@ typedef struct mmap_region mmap_region_t;
 #define PTE_G (1 << 5) // global
 #define PTE_A (1 << 6) // accessed
 #define PTE_D (1 << 7) // dirty
+#define PTE_SWAP (1 << 8) // RSW: V=0时表示页面已被换出, PPN字段存放交换槽号
+#define PTE_COW  (1 << 9) // RSW: 写时复制页面(W已清除, 写入时复制或恢复写权限)
 
 // 检查一个PTE是否属于pgtbl
 #define PTE_CHECK(pte) (((pte) & (PTE_R | PTE_W | PTE_X)) == 0)
@@ -64,12 +66,38 @@ typedef struct mmap_region mmap_region_t;
 // 获取低10bit的flag信息
 #define PTE_FLAGS(pte) ((pte) & 0x3FF)
 
+/*
+    Sv39允许在level-1直接放置叶子PTE, 它映射一个2MiB的megapage(大页)
+    大页要求虚拟地址和物理地址都按2MiB对齐
+    大页被部分解除映射或部分修改权限时会被拆分成512个4KiB的PTE
+*/
+#define HUGE_PGSIZE (PGSIZE * 512)
+#define HUGE_ROUND_UP(sz)   (((sz) + HUGE_PGSIZE - 1) & ~(HUGE_PGSIZE - 1))
+#define HUGE_ROUND_DOWN(a)  ((a) & ~(HUGE_PGSIZE - 1))
+
+/*
+    用户地址空间中专门留给mremap搬迁映射的区域
+    堆从低地址向上增长, 用户栈紧贴trapframe向下增长, 都不会进入这里
+*/
+#define MMAP_BASE (1ul << 36)   // 64GB
+#define MMAP_END  (1ul << 37)   // 128GB
+
+#define MREMAP_MAYMOVE 1        // 无法原地扩展时允许搬迁到新地址
+
+// proc_clone创建的线程各自的trapframe页, 紧贴mremap区域之上(没有PTE_U, 用户态不可访问)
+// i是线程的内核栈槽号(kstack_slot); 主线程的trapframe仍然位于TRAPFRAME
+#define THREAD_TF(i) (MMAP_END + (uint64)(i) * PGSIZE)
+
 /*---------------------- in kvm.c -------------------------*/
 
 void   vm_print(pgtbl_t pgtbl);
 pte_t* vm_getpte(pgtbl_t pgtbl, uint64 va, bool alloc);
+pte_t* vm_gethuge(pgtbl_t pgtbl, uint64 va);
+uint64 vm_walkaddr(pgtbl_t pgtbl, uint64 va);
+void   vm_split_huge(pgtbl_t pgtbl, uint64 va);
 void   vm_mappages(pgtbl_t pgtbl, uint64 va, uint64 pa, uint64 len, int perm);
 void   vm_unmappages(pgtbl_t pgtbl, uint64 va, uint64 len, bool freeit);
+void   vm_protect(pgtbl_t pgtbl, uint64 va, uint64 len, int perm);
 
 void   kvm_init();
 void   kvm_inithart();
@@ -86,6 +114,11 @@ void   uvm_munmap(uint64 begin, uint32 npages);
 
 uint64 uvm_heap_grow(pgtbl_t pgtbl, uint64 heap_top, uint32 len);
 uint64 uvm_heap_ungrow(pgtbl_t pgtbl, uint64 heap_top, uint32 len);
+uint32 uvm_huge_count(pgtbl_t pgtbl);
+uint64 uvm_mremap(pgtbl_t pgtbl, uint64 old, uint64 old_len, uint64 new_len, bool maymove);
+
+uint64 uvm_page_alloc();
+bool   uvm_fault(pgtbl_t pgtbl, uint64 va, bool write);
 
 void   uvm_copyin(pgtbl_t pgtbl, uint64 dst, uint64 src, uint32 len);
 void   uvm_copyout(pgtbl_t pgtbl, uint64 dst, uint64 src, uint32 len);
@@ -0,0 +1,30 @@
+#ifndef __WSS_H__
+#define __WSS_H__
+
+#include "common.h"
+
+/*
+    工作集估计
+    每隔WSS_INTERVAL个tick采样一次所有进程的用户页表:
+    PTE_A为1的页面空闲年龄清零, 否则年龄加一(最多到WSS_AGE_MAX), 随后清除A位和D位
+    页面的空闲年龄记录在页描述符中, 换出页面时优先选择年龄大的页面
+
+    进程最近n个周期的工作集 = 空闲年龄小于n的页面数
+*/
+
+#define WSS_INTERVAL   10                // 采样周期(时钟tick, 约1秒)
+#define WSS_AGE_MAX    15                // 空闲年龄上限
+#define WSS_BUCKETS    (WSS_AGE_MAX + 1) // 直方图的桶数
+#define WSS_COLD_AGE   4                 // 空闲年龄达到它的页面被认为是冷页面
+
+// 进程的工作集信息
+typedef struct wss {
+    uint32 hist[WSS_BUCKETS];  // 空闲年龄直方图: hist[i]是已经i个周期没被访问的页面数
+    uint32 dirty;              // 上个周期被写过的页面数
+    uint32 samples;            // 采样次数
+} wss_t;
+
+void   wss_sample(uint64* pgtbl, wss_t* wss);   // 采样并清除A/D位(调用者负责sfence)
+uint32 wss_size(wss_t* wss, uint32 n);           // 最近n个周期内被访问过的页面数
+
+#endif
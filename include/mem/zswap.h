@@ -0,0 +1,36 @@
+#ifndef __ZSWAP_H__
+#define __ZSWAP_H__
+
+#include "common.h"
+
+/*
+    压缩交换缓存(位于磁盘交换区之前的内存层)
+    换出的页面先尝试用LZ压缩后存入内核页组成的压缩池, 以交换槽号为索引
+    压缩池满或页面压缩效果太差时才真正写盘
+    换入时先查压缩池, 命中则直接解压, 不必读盘
+*/
+
+#define ZSWAP_POOL_PAGES 256                     // 压缩池最多占用的内核页(1MB)
+#define ZSWAP_CHUNK      128                     // 压缩池的分配粒度
+#define ZSWAP_CHUNKS     (PGSIZE / ZSWAP_CHUNK)  // 每个池页的块数
+#define ZSWAP_MAX_LEN    (PGSIZE / 2)            // 压缩后超过半页就不值得保存
+
+// 压缩交换缓存的统计信息
+typedef struct zswap_stat {
+    uint64 stored;        // 成功存入的页面数
+    uint64 rejected;      // 压缩效果差或池已满而写盘的页面数
+    uint64 hits;          // 换入时命中的次数
+    uint64 misses;        // 换入时未命中(需要读盘)的次数
+    uint64 orig_bytes;    // 当前缓存页面的原始大小
+    uint64 comp_bytes;    // 当前缓存页面压缩后的大小
+    uint32 entries;       // 当前缓存的页面数
+    uint32 pool_pages;    // 当前压缩池占用的内核页数
+} zswap_stat_t;
+
+void zswap_init();
+bool zswap_store(uint32 slot, uint64 pa);    // 压缩页面存入缓存, 失败时调用者应写盘
+bool zswap_load(uint32 slot, uint64 pa);     // 命中时解压到pa并返回true
+void zswap_invalidate(uint32 slot);          // 交换槽被释放时丢弃对应缓存
+void zswap_get_stat(zswap_stat_t* st);
+
+#endif
@@ -27,8 +27,10 @@
 #define CLINT_MTIMECMP(hartid) (CLINT_BASE + 0x4000 + 8 * (hartid))
 #define CLINT_MTIME (CLINT_BASE + 0xBFF8)
 
-// 内核栈相关 - 为每个CPU分配内核栈空间
-#define KSTACK(hartid) (0x3f80000000L + ((hartid) + 1) * 2 * PGSIZE)
+// 进程内核栈区域 - 每个槽由1个保护页和KSTACK_PAGES个栈页组成(见mem/kstack.h)
+// KSTACK(slot)是槽中栈页的最低地址, 它下方的保护页不映射
+#define KSTACK_BASE 0x3f80000000L
+#define KSTACK(slot) (KSTACK_BASE + (slot) * (KSTACK_PAGES + 1) * PGSIZE + PGSIZE)
 #define VIRTIO_BASE 0x10001000ul
 #define VIRTIO_IRQ 1
 #endif
\ No newline at end of file
@@ -3,17 +3,39 @@
 
 #include "common.h"
 #include "proc/proc.h"
+#include "proc/sched.h"
 
+// 每个hart各自的状态
+// 按cache line对齐, 避免不同hart写各自的字段时争用同一行
 typedef struct cpu {
     int noff;       // 关中断的深度
     int origin;     // 第一次关中断前的状态
-    int intena;     // 中断是否启用 - 兼容xv6
     proc_t* proc;   // cpu上运行的进程
+    proc_t* prev;   // 刚切换离开、锁还没有放开的进程(由切换到的一方放开, 见proc_switch_finish)
+    proc_t* fpu_owner; // 浮点寄存器里是哪个进程的状态(见proc/fpu.h)
     context_t ctx;  // 内核上下文暂存
-} cpu_t;
+    bool online;    // 是否已经进入调度器
+    bool idle;      // 没有可运行的进程, 停掉了周期时钟在wfi中等待
+
+    // 运行队列(见proc/sched.h)
+    spinlock_t rq_lk;                // 保护下面五个字段
+    proc_t* rq_head[MLFQ_LEVELS];    // 每个优先级层的队首, 最先被调度
+    proc_t* rq_tail[MLFQ_LEVELS];    // 每个优先级层的队尾
+    proc_t* dl_head;                 // 截止期进程队列, 按绝对截止期从早到晚排列
+    uint64 dl_bw;                    // 准入到这个hart的截止期进程占用的处理能力之和
+    int rq_len;                      // 所有层和截止期队列的进程总数(可以不加锁读取, 用于负载比较)
+    int load_avg;                    // 最近负载的指数平均(只由本hart更新, 见sched_tick)
+    uint64 balance_last;             // 上次负载均衡的tick
+
+    // 调度统计(见proc/schedstat.h)
+    cpu_schedstat_t stat;
+    uint64 stat_switch;              // 当前进程开始让出CPU的时间, 0表示没有正在进行的切换
+} __attribute__((aligned(64))) cpu_t;
 
 int     mycpuid(void);
 cpu_t*  mycpu(void);
+cpu_t*  cpu_get(int id);
 proc_t* myproc(void);
+void    ipi_send(int cpuid);  // 向一个hart发送处理器间中断(唤醒空闲的hart)
 
-#endif
\ No newline at end of file
+#endif
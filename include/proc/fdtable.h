@@ -0,0 +1,34 @@
+#ifndef __FDTABLE_H__
+#define __FDTABLE_H__
+
+#include "common.h"
+#include "lib/lock.h"
+
+typedef struct file file_t;
+
+/*
+    文件描述符表
+    fork复制一份新表(每个打开的文件引用数加一), proc_clone创建的线程共享同一张表
+    引用计数降到0时关闭表中所有的文件
+
+    查找返回的file_t*没有额外的引用: 同一张表的另一个线程同时关闭这个fd时
+    文件可能在使用中被释放, 用户程序应当自己避免这种竞争
+*/
+#define FILE_PER_PROC 16
+
+typedef struct fdtable {
+    spinlock_t lk;                  // 保护下面的字段
+    int ref;                        // 共享它的线程数
+    file_t* list[FILE_PER_PROC];    // fd -> 打开的文件
+} fdtable_t;
+
+void        fdtable_init();                                // 描述符表缓存初始化
+fdtable_t*  fdtable_alloc();                               // 申请一张空表
+void        fdtable_copy(fdtable_t* fdt, fdtable_t* old);  // fork: 把old中的文件复制进空表fdt
+fdtable_t*  fdtable_get(fdtable_t* fdt);                   // clone: 共享同一张表
+void        fdtable_put(fdtable_t* fdt);                   // 引用计数减一, 降到0时关闭所有文件
+int         fdtable_install(fdtable_t* fdt, file_t* file); // 占用最小的空闲fd, 失败返回-1
+file_t*     fdtable_lookup(fdtable_t* fdt, int fd);        // fd对应的文件, 无效返回NULL
+file_t*     fdtable_remove(fdtable_t* fdt, int fd);        // 摘除fd并返回原来的文件
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef __FPU_H__
+#define __FPU_H__
+
+#include "common.h"
+
+/*
+    浮点寄存器的惰性保存和恢复
+    内核自己不使用浮点指令, hart的浮点寄存器里总是某个用户进程的状态
+    sstatus.FS记录浮点单元的状态, 每个进程在用户态的FS由返回用户态时决定:
+
+    1. 没有用过浮点的进程FS为Off, 第一次执行浮点指令触发非法指令异常,
+       这时才给它一份清零的浮点状态(fpu_first_use), 只做整数运算的进程不保存也不恢复任何寄存器
+    2. 用过浮点的进程切换离开时, 只有FS为Dirty才把寄存器保存进p->fpu(fpu_switch_out)
+    3. 返回用户态时hart的寄存器里不是它的状态才从p->fpu恢复(fpu_user_return)
+       每个hart记录寄存器属于哪个进程(cpu->fpu_owner), 进程记录状态装在哪个hart上(p->fpu_cpu)
+       两者互相对应时寄存器就是它的, 在同一个hart上来回切换的进程不必恢复
+*/
+typedef struct fpu_state {
+    uint64 f[32];   // f0 ~ f31
+    uint64 fcsr;    // 舍入模式和异常标志
+} fpu_state_t;
+
+struct proc;
+
+// in fpu_regs.S (调用者保证sstatus.FS不是Off)
+void   fpu_save(fpu_state_t* fs);
+void   fpu_restore(fpu_state_t* fs);
+
+void   fpu_switch_out(struct proc* p);   // 进程切换离开之前调用(持有p->lk)
+uint64 fpu_user_return(struct proc* p);  // 返回用户态之前调用(关中断), 返回用户态应有的sstatus.FS
+bool   fpu_first_use(struct proc* p);    // 用户态非法指令异常: 第一次使用浮点时返回true
+void   fpu_flush(struct proc* p);        // 把当前进程寄存器里的浮点状态写回p->fpu(fork/clone复制之前)
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef __FUTEX_H__
+#define __FUTEX_H__
+
+#include "common.h"
+
+/*
+    futex: 用户态锁的慢路径
+    用户态用原子指令操作锁字, 没有竞争时完全不进入内核
+    发生竞争时调用FUTEX_WAIT在锁字上睡眠, 释放锁的一方发现有等待者时调用FUTEX_WAKE
+
+    等待键是锁字所在的物理页加页内偏移(即锁字的物理地址), 映射同一物理页的地址空间看到同一个键
+    等待期间页面被额外引用一次, 页面回收、同页合并和内存规整都不会移动它, 键保持不变
+    等待者按键散列到FUTEX_HASH个桶中, 每个桶是FIFO链表
+*/
+
+#define FUTEX_HASH    64
+
+#define FUTEX_WAIT    0   // *uaddr == val时睡眠, 直到被唤醒
+#define FUTEX_WAKE    1   // 最多唤醒val个等待者
+#define FUTEX_REQUEUE 2   // 最多唤醒val个等待者, 再把最多val2个等待者转移到uaddr2上
+
+void futex_init();
+int  futex_wait(uint64 uaddr, uint32 val);                                // 成功被唤醒返回0, 值不符或地址无效返回-1
+int  futex_wake(uint64 uaddr, uint32 nwake);                              // 返回唤醒的等待者数, 地址无效返回-1
+int  futex_requeue(uint64 uaddr, uint32 nwake, uint64 uaddr2, uint32 nmove); // 返回唤醒和转移的等待者总数
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef __KTHREAD_H__
+#define __KTHREAD_H__
+
+#include "proc/proc.h"
+
+/*
+    内核线程: 没有用户地址空间的进程, 只在内核态运行
+    和普通进程一样由proc_scheduler调度, 可以睡眠、被抢占
+    用于不属于任何系统调用的后台工作(同页合并、工作集采样、内存规整等)
+    入口函数返回即线程退出, 由第一个进程回收, 所以必须在proc_make_first之后创建
+*/
+
+proc_t* kthread_create(void (*fn)(void*), void* arg); // 创建内核线程, 失败返回NULL
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef __MM_H__
+#define __MM_H__
+
+#include "common.h"
+#include "lib/lock.h"
+#include "mem/wss.h"
+
+/*
+    用户地址空间: 页表以及堆、栈、mmap等描述它的状态
+    同一进程的所有线程(proc_clone创建)共享同一个mm_t, 用引用计数管理
+    最后一个线程释放时才销毁页表和其中的用户页面
+
+    lk串行化对页表结构的修改(缺页修复、堆伸缩、mremap、fork复制), 持有期间可以睡眠
+    后台扫描改写PTE仍然通过proc_pin固定所有线程, 不需要持有lk
+
+    描述符按需从对象缓存中申请, 所有存活的描述符串在一条链表上供后台扫描遍历(见mm_next)
+*/
+typedef struct mm {
+    int ref;                 // 共享它的线程数加上正在遍历它的扫描者(由mm_list_lk保护)
+    struct mm* next;         // 存活描述符链表(由mm_list_lk保护)
+    struct mm* prev;
+    sleeplock_t lk;          // 保护下面的字段和页表结构
+    uint64* pgtbl;           // 用户页表
+    uint64 heap_top;         // 用户堆顶(以字节为单位)
+    uint64 ustack_pages;     // 主线程用户栈占用的页面数量
+    struct mmap_region* mmap;// 用户可映射区域的起始节点
+    wss_t wss;               // 工作集估计(采样线程周期性采样)
+    bool wss_pending;        // 采样时有线程正在运行, 由它返回用户态之前补做
+} mm_t;
+
+void  mm_init();                // 描述符缓存初始化
+mm_t* mm_alloc(uint64* pgtbl);  // 为新页表申请地址空间描述符, 引用计数为1
+mm_t* mm_get(mm_t* mm);         // 又一个线程共享mm
+void  mm_put(mm_t* mm);         // 引用计数减一, 降到0时销毁页表
+mm_t* mm_next(mm_t* mm);        // 遍历所有地址空间: 持有返回值的引用并放掉mm的引用
+void  mm_lock(mm_t* mm);
+void  mm_unlock(mm_t* mm);
+bool  mm_holding(mm_t* mm);
+
+#endif
@@ -2,6 +2,11 @@
 #define __PROC_H__
 
 #include "lib/lock.h"
+#include "proc/mm.h"
+#include "proc/fdtable.h"
+#include "proc/fpu.h"
+#include "dev/twheel.h"
+#include "proc/schedstat.h"
 
 // 页表类型定义
 typedef uint64* pgtbl_t;
@@ -9,9 +14,6 @@ typedef uint64* pgtbl_t;
 // mmap_region定义
 typedef struct mmap_region mmap_region_t;
 
-// 前向声明
-typedef struct file file_t;
-
 // context 定义
 typedef struct context {
   uint64 ra; // 返回地址
@@ -76,7 +78,8 @@ typedef struct trapframe {
 /* 
     进程状态集合
     可能的进程状态变换：
-    UNSED -> RUNNABLE 进程初始化
+    UNSED -> USED 进程被申请(fork尚未完成)
+    USED -> RUNNABLE 进程初始化
     RUNNABLE -> RUNNIGN 进程获得CPU使用权
     RUNNING -> RUNNABLE 进程失去CPU使用权
     RUNNING -> SLEEPING 进程睡眠
@@ -87,12 +90,16 @@ typedef struct trapframe {
 */
 enum proc_state {
     UNUSED,       // 未被使用
+    USED,         // 已申请但尚未初始化完成
     RUNNABLE,     // 准备就绪
     RUNNING,      // 运行中
     SLEEPING,     // 睡眠等待
     ZOMBIE,       // 濒临死亡
 };
 
+// proc_wait的选项
+#define WNOHANG 1   // 没有已退出的子进程时不睡眠, 立即返回0
+
 // 进程定义
 typedef struct proc {
 
@@ -102,42 +109,93 @@ typedef struct proc {
 
     int pid;                 // 标识符
     enum proc_state state;   // 进程状态
-    struct proc* parent;     // 父进程
+    struct proc* parent;     // 父进程(由wait_lk保护)
+    struct proc* children;   // 第一个子进程(由wait_lk保护)
+    struct proc* sibling;    // 父进程的下一个子进程(由wait_lk保护)
     int exit_state;          // 进程退出时的状态(父进程可能关心)
     void* sleep_space;       // 睡眠是为在等待什么
+    struct proc* sleep_next; // 睡眠队列中的下一个进程(由睡眠队列的桶锁保护)
 
-    // 文件描述符表
-    #define FILE_PER_PROC 16
-    file_t* filelist[FILE_PER_PROC];       // 文件描述符表
-
-    // 时间片轮转调度字段
+    // 多级反馈队列调度字段(见proc/sched.h)
+    int prio;                // 当前所在的优先级层, 0最高
+    int nice;                // 允许进入的最高优先级层(nice越大优先级越低)
     uint64 time_slice;       // 当前时间片剩余ticks
     uint64 total_time;       // 进程总运行时间
-
-    pgtbl_t pgtbl;           // 用户态页表
-    uint64 heap_top;         // 用户堆顶(以字节为单位)
-    uint64 ustack_pages;     // 用户栈占用的页面数量
-    mmap_region_t* mmap;     // 用户可映射区域的起始节点
-    trapframe_t* tf;         // 用户态内核态切换时的运行环境暂存空间
+    uint64 cpumask;          // 允许运行的hart(CPU亲和性, 见proc/sched.h)
+    int cpu;                 // 所在运行队列的hart, 或者最近一次运行的hart
+
+    // 截止期调度字段(dl_runtime为0表示普通进程, 见proc/sched.h), 单位都是tick
+    uint64 dl_runtime;       // 每个周期的运行预算
+    uint64 dl_deadline;      // 相对截止期(从周期开始算起)
+    uint64 dl_period;        // 周期
+    uint64 dl_bw;            // 占用的hart处理能力(dl_runtime / dl_deadline, 定点数)
+    int dl_cpu;              // 准入时分配的hart, 只在这个hart上运行
+    uint64 dl_release;       // 当前周期的开始时间
+    uint64 dl_abs;           // 当前周期的绝对截止期(EDF按它排序)
+    uint64 dl_left;          // 本周期剩余的预算
+    bool dl_throttled;       // 预算用完, 等待下一个周期(不在任何队列中)
+    twheel_event_t dl_timer; // 节流结束时补充预算
+
+    // 调度统计(见proc/schedstat.h)
+    proc_schedstat_t stat;
+    uint64 stat_enqueued;    // 最近一次进入运行队列的时间
+    uint64 stat_oncpu;       // 最近一次开始运行的时间
+    int stat_last_cpu;       // 上一次运行的hart(-1表示还没有运行过)
+
+    /* 同一进程的线程共享下面两项(见proc_clone), 最后一个线程释放时才销毁 */
+    mm_t* mm;                // 用户地址空间(内核线程为NULL)
+    fdtable_t* files;        // 文件描述符表(内核线程为NULL)
+    pgtbl_t pgtbl;           // 用户态页表(即mm->pgtbl)
+
+    trapframe_t* tf;         // 用户态内核态切换时的运行环境暂存空间(每个线程一份)
+    uint64 tf_va;            // trapframe在用户页表中的虚拟地址
+
+    // 浮点状态(惰性保存和恢复, 见proc/fpu.h)
+    bool fpu_used;           // 是否使用过浮点单元
+    int fpu_cpu;             // 浮点状态装在哪个hart的寄存器里(-1表示没有装入)
+    fpu_state_t fpu;         // 切换离开时保存的浮点寄存器
 
     uint64 kstack;           // 内核栈的虚拟地址
+    void (*kfn)(void*);      // 内核线程的入口函数(用户进程为NULL)
+    void* karg;              // 内核线程入口函数的参数
     context_t ctx;           // 内核态进程上下文
+    struct proc* rq_next;    // 运行队列中的下一个进程
+
+    /* 进程表(见proc.c) */
+    struct proc* all_next;   // 存活进程链表(由ptable_lk保护)
+    struct proc* all_prev;
+    struct proc* pid_next;   // pid散列桶中的下一个进程(由ptable_lk保护)
+    struct proc* pin_next;   // 被proc_pin一起固定的下一个线程(持有p->lk时有效)
 } proc_t;
 
 void     proc_init();                                  // 进程模块初始化
 void     proc_make_first();                            // 创建第一个进程并切换到它执行
 pgtbl_t  proc_pgtbl_init(uint64 trapframe);            // 进程页表的初始化和基本映射
 proc_t*  proc_alloc();                                 // 进程申请
-void     proc_free(proc_t* p);                         // 进程释放
+proc_t*  proc_alloc_kernel(void (*entry)());           // 内核线程申请(只有内核栈)
+void     proc_free(proc_t* p);                         // 释放进程占用的资源(描述符由调用者归还)
 int      proc_fork();                                  // 复制子进程
-int      proc_wait(uint64 addr);                       // 等待子进程退出
+int      proc_clone(uint64 stack);                     // 创建共享地址空间和文件的线程
+int      proc_wait(int pid, uint64 addr, int options); // 等待子进程退出(pid <= 0表示任意子进程)
 void     proc_exit(int exit_state);                    // 进程退出
 void     proc_yield();                                 // 进程放弃CPU
 void     proc_sleep(void* sleep_space,spinlock_t* x);// 进程睡眠
-void     proc_wakeup(void* sleep_space);               // 进程唤醒
-void     proc_sched();                                 // 进程切换到调度器
+void     proc_wakeup(void* sleep_space);               // 唤醒所有等待者
+void     proc_wakeup_one(void* sleep_space);           // 只唤醒最早的一个等待者
+void     proc_sched();                                 // 进程切换到下一个进程或调度器
+void     proc_switch_finish();                         // 切换完成后放开切换离开的进程的锁
 void     proc_scheduler();                             // 调度器
+int      proc_wss(int pid, wss_t* wss);                // 查询进程的工作集信息
+void     proc_wss_daemon(void* arg);                   // 工作集采样的内核线程
+proc_t*  proc_pin(pgtbl_t pgtbl);                      // 固定页表所属进程, 使它暂停运行
+void     proc_unpin(proc_t* p);                        // 解除固定
 
 // 时间片轮转相关函数
-void     proc_reset_time_slice(proc_t* p);             // 重置进程时间片
+void     proc_reset_time_slice(proc_t* p);             // 按当前优先级层重置进程时间片
+void     proc_boost();                                 // 周期性优先级提升
+int      proc_nice(int inc);                           // 调整当前进程的nice值
+int      proc_setaffinity(int pid, uint64 mask);       // 设置进程允许运行的hart
+int      proc_getaffinity(int pid, uint64* mask);      // 查询进程允许运行的hart
+int      proc_setdeadline(uint64 runtime, uint64 deadline, uint64 period); // 当前进程加入或离开截止期调度
+int      proc_schedstat(int pid, proc_schedstat_t* st); // 查询进程的调度统计
 #endif
\ No newline at end of file
@@ -0,0 +1,84 @@
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+#include "common.h"
+#include "proc/proc.h"
+#include "dev/timer.h"
+
+/*
+    每个hart有自己的运行队列, 队列按优先级分成MLFQ_LEVELS层(多级反馈队列)
+    每层是RUNNABLE进程组成的FIFO链表, 通过proc.rq_next串起来
+    调度器总是从本hart最高的非空层取进程, 队列为空时从最长的队列中窃取一个
+    入队: 让出CPU的进程回到当前hart的队列, 被唤醒或新创建的进程放到负载最轻的hart
+
+    空闲的hart停掉周期时钟在wfi中等待(sched_idle), 入队时按需用处理器间中断叫醒:
+    目标hart空闲时叫醒它; 目标hart忙而进程需要排队时叫醒一个空闲的hart来窃取
+
+    优先级变化:
+    1. 新进程从nice允许的最高层开始
+    2. 用完整个时间片的进程降一级, 下一层的时间片是这一层的两倍
+    3. 时间片还剩一半以上就睡眠的进程(交互型)升一级, 但不会高于nice
+    4. 每MLFQ_BOOST个tick所有进程回到nice允许的最高层, 避免低层进程饿死
+    时间片跨越睡眠和让出保留剩余值, 只在升降级时重置, 进程无法靠频繁让出CPU逃避降级
+
+    CPU亲和性: p->cpumask的第i位为1表示p可以在hart i上运行
+    入队时不允许的hart会被换成允许的hart中负载最轻的一个, 窃取和负载均衡也只取允许在本hart运行的进程
+
+    负载均衡: 每个hart在自己的时钟中断里维护最近负载的指数平均(load_avg, 一个进程记为SCHED_LOAD_SCALE)
+    每SCHED_BALANCE个tick与最忙的hart比较一次, 相差超过一个进程时把一半的差距拉到自己的队列
+    优先拉最低层的进程; 空闲的hart不参与(停掉了周期时钟), 它们醒来后直接窃取
+
+    截止期调度(EDF): 设置了(runtime, deadline, period)的进程每个周期最多运行runtime个tick,
+    并且应当在周期开始后deadline个tick之内完成
+    - 准入控制: 进程的带宽runtime/deadline加上hart上已有的带宽不超过SCHED_DL_LIMIT时才接受,
+      进程被分配到一个允许的hart上(分区EDF), 只在那里运行, 不参与窃取和负载均衡
+    - 选择: 截止期进程排在所有普通进程之前, 其中绝对截止期最早的先运行
+      普通进程在有截止期进程就绪时让出CPU, 截止期进程在有更早截止的进程就绪时让出
+    - 节流: 预算用完的进程离开队列, 由时间轮在下一个周期开始时补充预算并放回
+      入队时上一个周期已经结束就开始新的周期; 截止期已过而周期未结束时只能用完剩余的预算
+
+    加锁顺序: p->lk -> rq_lk, 两个hart的rq_lk按hart编号从小到大获取
+    调度器出队后先释放rq_lk再获取p->lk, 所以出队不会和入队形成环
+    直接切换(sched_next_locked)在rq_lk下只尝试获取p->lk, 也不会形成环
+    一个RUNNABLE进程恰好位于一个队列中, 出队的hart独占它
+    p->prio在进程不在队列中时由p->lk保护; 周期性提升时在队列中被改写, 随后统一重新分层
+*/
+
+#define MLFQ_LEVELS 4                                      // 优先级层数
+#define MLFQ_QUANTUM(level) ((uint64)TIME_SLICE << (level)) // 第level层的时间片长度(ticks)
+#define MLFQ_BOOST 50                                      // 优先级提升的周期(ticks)
+
+#define SCHED_BALANCE 4                                    // 负载均衡的周期(ticks)
+#define SCHED_LOAD_SHIFT 10
+#define SCHED_LOAD_SCALE (1 << SCHED_LOAD_SHIFT)           // 一个进程的负载
+
+#define SCHED_DL_SHIFT 20
+#define SCHED_DL_SCALE (1ul << SCHED_DL_SHIFT)             // 一个hart的全部处理能力
+#define SCHED_DL_LIMIT (SCHED_DL_SCALE * 95 / 100)         // 截止期进程最多占用的比例, 其余留给普通进程
+#define SCHED_DL_MAX   (1ul << 32)                         // period的上限(ticks), 保证带宽和截止期的计算不溢出
+
+#define CPU_MASK_ALL ((1ul << NCPU) - 1)                   // 允许在所有hart上运行
+#define CPU_ALLOWED(p, id) (((p)->cpumask >> (id)) & 1)    // p是否允许在hart id上运行
+
+void    sched_init();                      // 运行队列初始化
+void    sched_online();                    // 当前hart开始参与调度
+void    sched_ready(proc_t* p, int cpuid); // p设为RUNNABLE并加入cpuid的运行队列(持有p->lk)
+bool    sched_dequeue(proc_t* p);          // 把RUNNABLE的p从所在的队列摘下, 已被调度器取走时返回false(持有p->lk)
+int     sched_pick_cpu(proc_t* p);         // p允许运行的hart中负载最轻的(与当前hart一样轻时选当前hart)
+uint64  sched_online_mask();               // 已经参与调度的hart
+proc_t* sched_next();                      // 取出下一个要运行的进程, 没有返回NULL
+proc_t* sched_next_locked();               // 同上, 但只取能立即锁住的进程, 返回时持有它的锁(直接切换用)
+void    sched_tick();                      // 每个hart的时钟中断中调用: 更新负载, 周期性负载均衡
+void    sched_idle();                      // 没有可运行的进程时停掉时钟等待
+bool    sched_preempt(proc_t* p);          // 当前进程是否应当让出CPU(持有p->lk)
+void    sched_promote(proc_t* p);          // 进程即将睡眠时调整优先级(持有p->lk)
+void    sched_requeue();                   // 按进程新的优先级重新分层(优先级提升之后)
+int     sched_setdeadline(proc_t* p, uint64 runtime, uint64 deadline, uint64 period); // 加入或离开截止期调度(持有p->lk)
+
+// 调度统计(见proc/schedstat.h)
+void    sched_stat_out(proc_t* p, bool direct); // p即将切换离开(持有p->lk, 关中断)
+void    sched_stat_in(proc_t* p);               // p即将开始运行(持有p->lk, 关中断)
+void    sched_stat_done();                      // 切换完成, 在新进程的上下文中调用(关中断)
+int     sched_cpustat(int id, cpu_schedstat_t* st); // 查询hart的调度统计
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef __SCHEDSTAT_H__
+#define __SCHEDSTAT_H__
+
+#include "common.h"
+
+/*
+    调度统计: 每个进程和每个hart各自的计数器, 通过sched_stats系统调用读取
+    时间用rdtime读取的mtime计数(频率为TIMER_FREQ, qemu virt上一个单位是100ns)
+    直方图按log2分桶: 第i个桶统计落在[2^i, 2^(i+1))之间的次数, 0落在第0个桶
+
+    进程的计数器在持有p->lk时更新; hart的计数器只由自己在关中断时更新
+    读取时不加锁, 得到的是一个近似的快照
+*/
+
+#define SCHEDSTAT_BUCKETS 32
+
+// sched_stats系统调用的查询对象
+#define SCHEDSTAT_PROC 0   // 一个进程(id为pid, 0表示当前进程)
+#define SCHEDSTAT_CPU  1   // 一个hart(id为hartid)
+
+typedef struct proc_schedstat {
+    uint64 run_time;        // 在CPU上运行的总时间
+    uint64 wait_time;       // 在运行队列中等待的总时间
+    uint64 wait_max;        // 单次等待的最长时间
+    uint64 nr_runs;         // 被调度运行的次数
+    uint64 nr_voluntary;    // 自愿让出CPU的次数(睡眠、退出)
+    uint64 nr_involuntary;  // 非自愿让出CPU的次数(时间片用完、被抢占、迁移)
+    uint64 nr_migrations;   // 换到另一个hart上运行的次数
+} proc_schedstat_t;
+
+typedef struct cpu_schedstat {
+    uint64 nr_ticks;                        // 处理的时钟中断次数
+    uint64 nr_switches;                     // 从一个进程切换离开的次数
+    uint64 nr_direct;                       // 其中直接切换到下一个进程(不经过调度器循环)的次数
+    uint64 idle_time;                       // 停掉周期时钟等待的总时间
+    uint64 wait_hist[SCHEDSTAT_BUCKETS];    // 进程在运行队列中的等待时间
+    uint64 switch_hist[SCHEDSTAT_BUCKETS];  // 从进程让出CPU到下一个进程开始运行的耗时(不含空闲)
+} cpu_schedstat_t;
+
+#endif
@@ -53,6 +53,11 @@ w_pmpcfg0(uint64 x)
 #define SSTATUS_UPIE (1L << 4) // User Previous Interrupt Enable
 #define SSTATUS_SIE (1L << 1)  // Supervisor Interrupt Enable
 #define SSTATUS_UIE (1L << 0)  // User Interrupt Enable
+#define SSTATUS_FS (3L << 13)  // 浮点单元状态: Off时浮点指令触发非法指令异常
+#define SSTATUS_FS_OFF     (0L << 13)
+#define SSTATUS_FS_INITIAL (1L << 13)
+#define SSTATUS_FS_CLEAN   (2L << 13) // 浮点寄存器与上次保存或恢复时一致
+#define SSTATUS_FS_DIRTY   (3L << 13) // 浮点寄存器被改写过
 
 static inline uint64 r_sstatus()
 {
@@ -14,6 +14,20 @@ uint64 sys_fork();
 uint64 sys_wait();
 uint64 sys_exit();
 uint64 sys_sleep();
+uint64 sys_huge_count();
+uint64 sys_zswap_stat();
+uint64 sys_ksm_stat();
+uint64 sys_wss();
+uint64 sys_compact();
+uint64 sys_mremap();
+uint64 sys_nice();
+uint64 sys_clone();
+uint64 sys_futex();
+uint64 sys_sched_setaffinity();
+uint64 sys_sched_getaffinity();
+uint64 sys_waitpid();
+uint64 sys_sched_setdeadline();
+uint64 sys_sched_stats();
 
 // 文件系统相关的系统调用
 
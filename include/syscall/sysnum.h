@@ -28,8 +28,22 @@
 #define SYS_read_block   23
 #define SYS_write_block  24
 #define SYS_release_block 25
+#define SYS_huge_count   26
+#define SYS_zswap_stat   27
+#define SYS_ksm_stat     28
+#define SYS_wss          29
+#define SYS_compact      30
+#define SYS_mremap       31
+#define SYS_nice         32
+#define SYS_clone        33
+#define SYS_futex        34
+#define SYS_sched_setaffinity 35
+#define SYS_sched_getaffinity 36
+#define SYS_waitpid      37
+#define SYS_sched_setdeadline 38
+#define SYS_sched_stats  39
 
 
-#define SYS_MAX          25
+#define SYS_MAX          39
 
 #endif
\ No newline at end of file
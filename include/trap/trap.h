@@ -20,9 +20,10 @@ void trap_kernel_handler();
 void trap_user_handler();
 void trap_user_return();
 
-// 辅助函数: 外设中断和时钟中断处理
+// 辅助函数: 外设中断、时钟中断和软件中断处理
 
 void external_interrupt_handler();
 void timer_interrupt_handler();
+void soft_interrupt_handler();
 
 #endif
\ No newline at end of file
@@ -6,7 +6,12 @@
 #include "trap/trap.h"
 #include "mem/pmem.h"
 #include "mem/vmem.h"
+#include "mem/ksm.h"
+#include "mem/rmap.h"
+#include "mem/compact.h"
+#include "mem/kstack.h"
 #include "proc/proc.h"
+#include "proc/kthread.h"
 #include "fs/fs.h"
 
 volatile static int started = 0;
@@ -25,10 +30,14 @@ int main()
 
         // 初始化物理内存管理
         pmem_init();
+        rmap_init();
+        ksm_init();
+        compact_init();
 
         // 初始化内核页表和虚拟内存
         kvm_init();
         kvm_inithart();
+        kstack_init();
 
         // 初始化trap处理
         trap_kernel_init();
@@ -45,7 +54,7 @@ int main()
         started = 1;
 
     } else {
-        // CPU 1 等待CPU 0完成初始化
+        // 其他CPU等待CPU 0完成初始化
         while(started == 0);
         __sync_synchronize();
 
@@ -62,18 +71,17 @@ int main()
     intr_on();
 
     if(cpuid == 0) {
-        // CPU 0 创建并切换到第一个用户进程
+        // CPU 0 创建第一个用户进程, 由调度器选中它运行
         printf("CPU %d: Creating first user process...\n", cpuid);
         proc_make_first();
-        // proc_make_first() 不会返回，直接切换到用户进程
-        //panic("proc_make_first returned");
-    } else {
-        // CPU 1 进入空闲循环等待时钟中断
-        printf("CPU %d: Entering idle loop, waiting for interrupts...\n", cpuid);
-        while (1) {
-            // CPU 1 空闲等待
-        }
+
+        // 后台内存维护交给内核线程
+        kthread_create(ksm_daemon, NULL);
+        kthread_create(proc_wss_daemon, NULL);
+        kthread_create(compact_daemon, NULL);
     }
+
+    // 每个CPU都进入调度器
     proc_scheduler();
     return 0;
 }
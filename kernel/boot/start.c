@@ -3,6 +3,8 @@
 
 void main();
 __attribute__ ((aligned (16))) uint8 CPU_stack[4096 * NCPU];
+// entry.S用它判断hartid是否超出CPU_stack的范围
+uint64 CPU_num = NCPU;
 
 // 外部符号，由链接脚本定义
 extern char sbss[];
@@ -1,6 +1,8 @@
 #include "lib/lock.h"
 #include "lib/print.h"
 #include "dev/timer.h"
+#include "dev/twheel.h"
+#include "proc/cpu.h"
 #include "memlayout.h"
 #include "riscv.h"
 
@@ -10,7 +12,7 @@
 extern void timer_vector();
 
 // 每个CPU在时钟中断中需要的临时空间(考虑为什么可以这么写)
-static uint64 mscratch[NCPU][5];
+static uint64 mscratch[NCPU][7];
 
 // 时钟初始化
 // called in start.c
@@ -22,8 +24,12 @@ void timer_init()
     // mscratch[hartid][0-2]: 暂存a1, a2, a3寄存器
     // mscratch[hartid][3]: CLINT_MTIMECMP(hartid)地址
     // mscratch[hartid][4]: INTERVAL值
+    // mscratch[hartid][5]: CLINT_MSIP(hartid)地址(处理器间中断)
+    // mscratch[hartid][6]: 时钟中断标志, M-mode置1, S-mode取走
     mscratch[hartid][3] = CLINT_MTIMECMP(hartid);
     mscratch[hartid][4] = INTERVAL;
+    mscratch[hartid][5] = CLINT_MSIP(hartid);
+    mscratch[hartid][6] = 0;
 
     // 设置mscratch寄存器指向当前CPU的临时空间
     w_mscratch((uint64)&mscratch[hartid]);
@@ -34,8 +40,11 @@ void timer_init()
     // 设置第一次时钟中断时间
     *(uint64*)CLINT_MTIMECMP(hartid) = *(uint64*)CLINT_MTIME + INTERVAL;
 
-    // 启用M-mode时钟中断
-    w_mie(r_mie() | MIE_MTIE);
+    // 启用M-mode时钟中断和软件中断(处理器间中断)
+    w_mie(r_mie() | MIE_MTIE | MIE_MSIE);
+
+    // 允许S-mode用rdtime读取mtime(调度统计使用)
+    w_mcounteren(r_mcounteren() | 2);
 }
 
 
@@ -44,30 +53,54 @@ void timer_init()
 // 系统时钟
 static timer_t sys_timer;
 
+static uint64 mtime()
+{
+    return *(volatile uint64*)CLINT_MTIME;
+}
+
 // 时钟创建(初始化系统时钟)
 void timer_create()
 {
-    // 初始化系统时钟
-    sys_timer.ticks = 0;
-    spinlock_init(&sys_timer.lk, "sys_timer");
+    // 从现在开始计数
+    sys_timer.base = mtime();
+    twheel_init();
 }
 
-// 时钟更新(ticks++ with lock)
+// 时钟更新: 把时间轮推进到当前tick
+// 停掉周期时钟之后醒来时可能一次跨过很多个tick
 void timer_update()
 {
-    // 加锁保护共享资源
-    spinlock_acquire(&sys_timer.lk);
-    sys_timer.ticks++;
-    spinlock_release(&sys_timer.lk);
+    twheel_run(timer_get_ticks());
 }
 
 // 返回系统时钟ticks
 uint64 timer_get_ticks()
 {
-    uint64 ticks;
-    // 加锁保护共享资源
-    spinlock_acquire(&sys_timer.lk);
-    ticks = sys_timer.ticks;
-    spinlock_release(&sys_timer.lk);
-    return ticks;
-}
\ No newline at end of file
+    return (mtime() - sys_timer.base) / INTERVAL;
+}
+
+// S-mode软件中断既可能来自时钟也可能来自其他hart
+// 取走当前hart的时钟中断标志, 返回这次软件中断是否包含时钟中断
+bool timer_tick_pending()
+{
+    return __atomic_exchange_n(&mscratch[mycpuid()][6], 0, __ATOMIC_ACQ_REL) != 0;
+}
+
+/*
+    无时钟空闲(tickless idle):
+    空闲的hart直接改写自己的mtimecmp, 停掉周期时钟
+    之后只有deadline到期(M-mode处理程序从deadline开始重新按INTERVAL计时)
+    或者其他hart发来处理器间中断时才会醒来, 醒来后立即恢复周期时钟
+*/
+void timer_tick_stop(uint64 deadline)
+{
+    uint64 cmp = TIMER_NEVER;
+    if (deadline != TIMER_NEVER)
+        cmp = sys_timer.base + deadline * INTERVAL;
+    *(volatile uint64*)CLINT_MTIMECMP(mycpuid()) = cmp;
+}
+
+void timer_tick_start()
+{
+    *(volatile uint64*)CLINT_MTIMECMP(mycpuid()) = mtime() + INTERVAL;
+}
@@ -0,0 +1,215 @@
+#include "dev/twheel.h"
+#include "dev/timer.h"
+#include "proc/proc.h"
+#include "proc/cpu.h"
+#include "lib/lock.h"
+#include "lib/print.h"
+
+static spinlock_t wheel_lk;                           // 保护下面所有字段和事件的链表指针
+static twheel_event_t* slots[TW_LEVELS][TW_SIZE];
+static uint64 wheel_next;                             // 下一个要处理的tick
+static uint64 idle_until;                             // CPU 0停掉周期时钟后醒来的tick, 0表示正常计时
+
+void twheel_init()
+{
+    spinlock_init(&wheel_lk, "twheel");
+    for (int l = 0; l < TW_LEVELS; l++)
+        for (int i = 0; i < TW_SIZE; i++)
+            slots[l][i] = NULL;
+    wheel_next = 0;
+    idle_until = 0;
+}
+
+void twheel_event_init(twheel_event_t* ev, void (*func)(void*), void* arg)
+{
+    ev->expires = 0;
+    ev->func = func;
+    ev->arg = arg;
+    ev->armed = false;
+    ev->next = NULL;
+    ev->prev = NULL;
+    ev->slot = NULL;
+}
+
+// 头插到链表 (持有wheel_lk)
+static void list_push(twheel_event_t** head, twheel_event_t* ev)
+{
+    ev->prev = NULL;
+    ev->next = *head;
+    if (*head != NULL)
+        (*head)->prev = ev;
+    *head = ev;
+    ev->slot = head;
+}
+
+// 从所在链表摘除 (持有wheel_lk)
+static void list_remove(twheel_event_t* ev)
+{
+    if (ev->prev != NULL)
+        ev->prev->next = ev->next;
+    else
+        *ev->slot = ev->next;
+    if (ev->next != NULL)
+        ev->next->prev = ev->prev;
+    ev->next = NULL;
+    ev->prev = NULL;
+    ev->slot = NULL;
+}
+
+// 按距离到期的tick数选择层和槽 (持有wheel_lk)
+// 已经过期的事件放进下一个要处理的槽; 超出范围的先放在最高层, 级联时再重新计算
+static void wheel_insert(twheel_event_t* ev)
+{
+    uint64 e = ev->expires < wheel_next ? wheel_next : ev->expires;
+    uint64 max = (1ul << (TW_LEVELS * TW_BITS)) - 1;
+    if (e - wheel_next > max)
+        e = wheel_next + max;
+
+    uint64 delta = e - wheel_next;
+    int level = 0;
+    while (level < TW_LEVELS - 1 && delta >= (1ul << ((level + 1) * TW_BITS)))
+        level++;
+    list_push(&slots[level][(e >> (level * TW_BITS)) & TW_MASK], ev);
+}
+
+// 把第level层第idx个槽中的事件重新分配到下面的层 (持有wheel_lk)
+static void cascade(int level, int idx)
+{
+    twheel_event_t* ev = slots[level][idx];
+    slots[level][idx] = NULL;
+    while (ev != NULL) {
+        twheel_event_t* next = ev->next;
+        wheel_insert(ev);
+        ev = next;
+    }
+}
+
+void twheel_add(twheel_event_t* ev, uint64 expires)
+{
+    spinlock_acquire(&wheel_lk);
+    if (ev->armed)
+        list_remove(ev);
+    ev->expires = expires;
+    ev->armed = true;
+    wheel_insert(ev);
+    // CPU 0正在空闲且会醒得太晚: 叫醒它重新计算
+    bool kick = expires < idle_until;
+    if (kick)
+        idle_until = expires;
+    spinlock_release(&wheel_lk);
+    if (kick)
+        ipi_send(0);
+}
+
+void twheel_add_after(twheel_event_t* ev, uint64 delta)
+{
+    twheel_add(ev, timer_get_ticks() + delta);
+}
+
+bool twheel_cancel(twheel_event_t* ev)
+{
+    spinlock_acquire(&wheel_lk);
+    bool armed = ev->armed;
+    if (armed) {
+        list_remove(ev);
+        ev->armed = false;
+    }
+    spinlock_release(&wheel_lk);
+    return armed;
+}
+
+// 由timer_update在CPU 0的时钟中断中调用
+void twheel_run(uint64 now)
+{
+    spinlock_acquire(&wheel_lk);
+    while (wheel_next <= now) {
+        int idx = wheel_next & TW_MASK;
+        // 第0层转完一圈: 逐层级联, 上一层的槽号也回到0时继续向上
+        if (idx == 0) {
+            for (int l = 1; l < TW_LEVELS; l++) {
+                int i = (wheel_next >> (l * TW_BITS)) & TW_MASK;
+                cascade(l, i);
+                if (i != 0)
+                    break;
+            }
+        }
+        wheel_next++;
+
+        // 到期链表挂在局部的表头上, 回调期间其他CPU仍然可以取消其中的事件
+        twheel_event_t* expired = NULL;
+        while (slots[0][idx] != NULL) {
+            twheel_event_t* ev = slots[0][idx];
+            list_remove(ev);
+            list_push(&expired, ev);
+        }
+        while (expired != NULL) {
+            twheel_event_t* ev = expired;
+            list_remove(ev);
+            ev->armed = false;
+            void (*func)(void*) = ev->func;
+            void* arg = ev->arg;
+            spinlock_release(&wheel_lk);
+            func(arg);
+            spinlock_acquire(&wheel_lk);
+        }
+    }
+    spinlock_release(&wheel_lk);
+}
+
+// 回调的参数是睡眠的进程而不是栈上的事件: armed在回调执行之前就被清除,
+// 睡眠者可能已经返回, 事件所在的栈帧随之失效
+// 晚到的唤醒只会落在进程自己的通道上, 在那里睡眠的代码都会重新检查条件
+static void sleep_timeout(void* arg)
+{
+    proc_wakeup(arg);
+}
+
+// 挂一个定时事件后睡眠, 到期之前不占用任何调度机会
+void twheel_sleep(uint64 ticks)
+{
+    proc_t* p = myproc();
+    twheel_event_t ev;
+    twheel_event_init(&ev, sleep_timeout, p);
+    twheel_add_after(&ev, ticks);
+
+    // 以wheel_lk为条件锁: armed在同一把锁下被清除, 不会错过唤醒
+    spinlock_acquire(&wheel_lk);
+    while (ev.armed)
+        proc_sleep(p, &wheel_lk);
+    spinlock_release(&wheel_lk);
+}
+
+// 下一个可能有事件到期的tick, 没有任何事件返回TIMER_NEVER (持有wheel_lk)
+// 第0层之内的事件精确到tick; 更远的事件只需要在下一次级联时醒来, 级联之后再重新计算
+static uint64 next_expiry()
+{
+    for (int i = 0; i < TW_SIZE; i++) {
+        if (slots[0][(wheel_next + i) & TW_MASK] != NULL)
+            return wheel_next + i;
+    }
+    for (int l = 1; l < TW_LEVELS; l++) {
+        for (int i = 0; i < TW_SIZE; i++) {
+            if (slots[l][i] != NULL)
+                return (wheel_next + TW_MASK) & ~(uint64)TW_MASK;
+        }
+    }
+    return TIMER_NEVER;
+}
+
+// CPU 0没有可运行的进程, 准备停掉周期时钟
+// 返回它必须醒来的tick, 在此之前添加的更早的事件会通过处理器间中断叫醒它
+uint64 twheel_idle()
+{
+    spinlock_acquire(&wheel_lk);
+    uint64 deadline = next_expiry();
+    idle_until = deadline;
+    spinlock_release(&wheel_lk);
+    return deadline;
+}
+
+void twheel_idle_end()
+{
+    spinlock_acquire(&wheel_lk);
+    idle_until = 0;
+    spinlock_release(&wheel_lk);
+}
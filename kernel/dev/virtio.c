@@ -41,9 +41,11 @@ static struct disk
     // track info about in-flight operations,
     // for use when completion interrupt arrives.
     // indexed by first descriptor index of chain.
+    // busy points at the requester's completion flag
+    // (b->disk for buf requests), which is also the sleep channel.
     struct
     {
-        buf_t* b;
+        bool* busy;
         char status;
     } info[NUM];
 
@@ -142,7 +144,6 @@ free_desc(int i)
         panic("virtio_disk_intr 2");
     disk.desc[i].addr = 0;
     disk.free[i] = 1;
-    proc_wakeup(&disk.free[0]);
 }
 
 // free a chain of descriptors.
@@ -157,6 +158,8 @@ free_chain(int i)
         else
             break;
     }
+    // a whole chain is enough for exactly one waiter.
+    proc_wakeup_one(&disk.free[0]);
 }
 
 static int
@@ -175,10 +178,10 @@ alloc3_desc(int *idx)
     return 0;
 }
 
-void virtio_disk_rw(buf_t *b, bool write)
+// submit one request of len bytes at sector, using the
+// physically contiguous memory at data, and wait for it.
+static void disk_rw(uint64 sector, uint64 data, uint32 len, bool write, bool* busy)
 {
-    uint64 sector = b->block_num * (BLOCK_SIZE / 512);
-
     spinlock_acquire(&disk.vdisk_lock);
 
     // the spec says that legacy block operations use three
@@ -187,14 +190,20 @@ void virtio_disk_rw(buf_t *b, bool write)
 
     // allocate the three descriptors.
     int idx[3];
+    bool waited = false;
     while (1)
     {
         if (alloc3_desc(idx) == 0)
         {
             break;
         }
+        waited = true;
         proc_sleep(&disk.free[0], &disk.vdisk_lock);
     }
+    // we were woken exclusively; pass the wakeup on in case
+    // enough descriptors are left for the next waiter.
+    if (waited)
+        proc_wakeup_one(&disk.free[0]);
 
     // format the three descriptors.
     // qemu's virtio-blk.c reads them.
@@ -222,12 +231,12 @@ void virtio_disk_rw(buf_t *b, bool write)
     disk.desc[idx[0]].len = sizeof(buf0);
     disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
     disk.desc[idx[0]].next = idx[1];
-    disk.desc[idx[1]].addr = (uint64)b->data;
-    disk.desc[idx[1]].len = BLOCK_SIZE;
+    disk.desc[idx[1]].addr = data;
+    disk.desc[idx[1]].len = len;
     if (write)
-        disk.desc[idx[1]].flags = 0; // device reads b->data
+        disk.desc[idx[1]].flags = 0; // device reads data
     else
-        disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
+        disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes data
     disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
     disk.desc[idx[1]].next = idx[2];
 
@@ -237,8 +246,8 @@ void virtio_disk_rw(buf_t *b, bool write)
     disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
     disk.desc[idx[2]].next = 0;
     // record   for virtio_disk_intr().
-    b->disk = true;
-    disk.info[idx[0]].b = b;
+    *busy = true;
+    disk.info[idx[0]].busy = busy;
 
     // avail[0] is flags
     // avail[1] tells the device how far to look in avail[2...].
@@ -249,16 +258,30 @@ void virtio_disk_rw(buf_t *b, bool write)
     disk.avail[1] = disk.avail[1] + 1;
     *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
     // Wait for virtio_disk_intr() to say request has finished.
-    while (b->disk == true)
+    while (*busy == true)
     {
-        proc_sleep(b, &disk.vdisk_lock);
+        proc_sleep(busy, &disk.vdisk_lock);
     }
-    disk.info[idx[0]].b = 0;
+    disk.info[idx[0]].busy = 0;
     free_chain(idx[0]);
 
     spinlock_release(&disk.vdisk_lock);
 }
 
+void virtio_disk_rw(buf_t *b, bool write)
+{
+    disk_rw(b->block_num * (BLOCK_SIZE / 512), (uint64)b->data, BLOCK_SIZE, write, &b->disk);
+}
+
+// read or write one whole page starting at block_num with a
+// single request, so a page costs one round-trip instead of
+// PGSIZE / BLOCK_SIZE. pa must be a physical page address.
+void virtio_disk_rw_page(uint32 block_num, uint64 pa, bool write)
+{
+    bool busy = false;
+    disk_rw((uint64)block_num * (BLOCK_SIZE / 512), pa, PGSIZE, write, &busy);
+}
+
 void virtio_disk_intr()
 {
     spinlock_acquire(&disk.vdisk_lock);
@@ -270,8 +293,8 @@ void virtio_disk_intr()
         if (disk.info[id].status != 0)
             panic("virtio_disk_intr status");
 
-        disk.info[id].b->disk = false; // disk is done with buf
-        proc_wakeup(disk.info[id].b);
+        *disk.info[id].busy = false; // disk is done with the request
+        proc_wakeup_one(disk.info[id].busy); // only the submitter waits on it
 
         disk.used_idx = (disk.used_idx + 1) % NUM;
     }
@@ -50,6 +50,8 @@ static void sb_print()
     printf("inode start = %d\n", sb.inode_start);
     printf("data bitmap start = %d\n", sb.data_bitmap_start);
     printf("data start = %d\n", sb.data_start);
+    printf("swap start = %d\n", sb.swap_start);
+    printf("swap blocks = %d\n", sb.swap_blocks);
 }
 
 // 文件系统初始化
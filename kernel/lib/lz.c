@@ -0,0 +1,144 @@
+#include "lib/lz.h"
+#include "lib/str.h"
+
+static uint32 read32(const uint8* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32)p[3] << 24);
+}
+
+static uint32 lz_hash(uint32 v)
+{
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// 写入长度字段的扩展字节(len是token中记录的完整长度)
+static uint8* put_len(uint8* op, uint32 len)
+{
+    if (len < 15)
+        return op;
+    len -= 15;
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = len;
+    return op;
+}
+
+// 读取长度字段的扩展字节, 越界返回false
+static bool get_len(const uint8** ip, const uint8* iend, uint32* len)
+{
+    if (*len != 15)
+        return true;
+    uint8 b;
+    do {
+        if (*ip >= iend)
+            return false;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return true;
+}
+
+// 输出一个序列, mlen == 0 表示最后一个只有字面量的序列
+// 空间不足返回NULL
+static uint8* emit(uint8* op, uint8* oend, const uint8* lit, uint32 nlit, uint32 offset, uint32 mlen)
+{
+    // 按最坏情况检查空间: token + 字面量及其扩展 + offset + 匹配扩展
+    if (op + 1 + nlit + nlit / 255 + 1 + 2 + mlen / 255 + 1 > oend)
+        return NULL;
+
+    uint8* token = op++;
+    *token = (nlit >= 15 ? 15 : nlit) << 4;
+    op = put_len(op, nlit);
+    memmove(op, lit, nlit);
+    op += nlit;
+    if (mlen == 0)
+        return op;
+
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    mlen -= LZ_MIN_MATCH;
+    *token |= (mlen >= 15 ? 15 : mlen);
+    return put_len(op, mlen);
+}
+
+uint32 lz_compress(const uint8* src, uint32 len, uint8* dst, uint32 cap, uint16* table)
+{
+    const uint8* ip = src;
+    const uint8* anchor = src; // 尚未输出的字面量起点
+    const uint8* iend = src + len;
+    uint8* op = dst;
+    uint8* oend = dst + cap;
+
+    // 表项记录位置+1, 0表示空
+    memset(table, 0, LZ_HASH_SIZE * sizeof(uint16));
+
+    while (ip + LZ_MIN_MATCH <= iend) {
+        uint32 h = lz_hash(read32(ip));
+        uint32 cand = table[h];
+        table[h] = ip - src + 1;
+        if (cand == 0 || read32(src + cand - 1) != read32(ip)) {
+            ip++;
+            continue;
+        }
+
+        // 找到匹配, 尽量向后延长
+        const uint8* ref = src + cand - 1;
+        uint32 mlen = LZ_MIN_MATCH;
+        while (ip + mlen < iend && ref[mlen] == ip[mlen])
+            mlen++;
+
+        op = emit(op, oend, anchor, ip - anchor, ip - ref, mlen);
+        if (op == NULL)
+            return 0;
+        ip += mlen;
+        anchor = ip;
+    }
+
+    op = emit(op, oend, anchor, iend - anchor, 0, 0);
+    if (op == NULL)
+        return 0;
+    return op - dst;
+}
+
+uint32 lz_decompress(const uint8* src, uint32 clen, uint8* dst, uint32 cap)
+{
+    const uint8* ip = src;
+    const uint8* iend = src + clen;
+    uint8* op = dst;
+    uint8* oend = dst + cap;
+
+    while (ip < iend) {
+        uint8 token = *ip++;
+
+        uint32 nlit = token >> 4;
+        if (!get_len(&ip, iend, &nlit))
+            return 0;
+        if (nlit > iend - ip || nlit > oend - op)
+            return 0;
+        memmove(op, ip, nlit);
+        op += nlit;
+        ip += nlit;
+        if (ip == iend) // 最后一个序列
+            break;
+
+        if (iend - ip < 2)
+            return 0;
+        uint32 offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        uint32 mlen = token & 15;
+        if (!get_len(&ip, iend, &mlen))
+            return 0;
+        mlen += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op - dst || mlen > oend - op)
+            return 0;
+
+        // 匹配可能与输出重叠, 只能逐字节拷贝
+        const uint8* ref = op - offset;
+        for (uint32 i = 0; i < mlen; i++)
+            op[i] = ref[i];
+        op += mlen;
+    }
+    return op - dst;
+}
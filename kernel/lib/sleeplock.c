@@ -0,0 +1,40 @@
+#include "lib/lock.h"
+#include "proc/cpu.h"
+
+void sleeplock_init(sleeplock_t* lk, char* name)
+{
+    spinlock_init(&lk->lk, "sleeplock");
+    lk->name = name;
+    lk->locked = false;
+    lk->pid = 0;
+}
+
+// 获取睡眠锁, 锁被占用时在锁上睡眠
+void sleeplock_acquire(sleeplock_t* lk)
+{
+    spinlock_acquire(&lk->lk);
+    while (lk->locked)
+        proc_sleep(lk, &lk->lk);
+    lk->locked = true;
+    lk->pid = myproc()->pid;
+    spinlock_release(&lk->lk);
+}
+
+// 释放睡眠锁, 只叫醒一个等待者(锁一次只能给一个人)
+void sleeplock_release(sleeplock_t* lk)
+{
+    spinlock_acquire(&lk->lk);
+    lk->locked = false;
+    lk->pid = 0;
+    proc_wakeup_one(lk);
+    spinlock_release(&lk->lk);
+}
+
+// 当前进程是否持有睡眠锁
+bool sleeplock_holding(sleeplock_t* lk)
+{
+    spinlock_acquire(&lk->lk);
+    bool r = lk->locked && lk->pid == myproc()->pid;
+    spinlock_release(&lk->lk);
+    return r;
+}
@@ -68,4 +68,20 @@ void spinlock_release(spinlock_t *lk)
   __sync_lock_release(&lk->locked);
 
   pop_off();
-}
\ No newline at end of file
+}
+
+// 尝试获取自旋锁, 锁已被占用时立即返回false
+// 用于无法保证加锁顺序的场合
+bool spinlock_try_acquire(spinlock_t *lk)
+{
+  push_off();
+  if(spinlock_holding(lk))
+    panic("try_acquire");
+  if(__sync_lock_test_and_set(&lk->locked, 1) != 0) {
+    pop_off();
+    return false;
+  }
+  __sync_synchronize();
+  lk->cpuid = mycpuid();
+  return true;
+}
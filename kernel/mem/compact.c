@@ -0,0 +1,180 @@
+#include "mem/compact.h"
+#include "mem/pmem.h"
+#include "mem/rmap.h"
+#include "dev/twheel.h"
+#include "lib/print.h"
+
+static spinlock_t compact_lk;     // 同一时间只进行一次规整, 同时保护下面的字段
+static compact_stat_t stat;
+static uint32 defer_shift;        // 推迟2^defer_shift次请求
+static uint32 defer_count;        // 已经推迟的次数
+
+void compact_init()
+{
+    spinlock_init(&compact_lk, "compact");
+}
+
+int compact_frag_index()
+{
+    uint64 free_pages = 0, runs = 0;
+    bool in_run = false;
+
+    for (uint64 pa = user_region.begin; pa < user_region.end; pa += PGSIZE) {
+        bool free = (pmem_page(pa)->flags & PG_FREE) != 0;
+        if (free) {
+            free_pages++;
+            if (!in_run)
+                runs++;
+        }
+        in_run = free;
+    }
+
+    // 存在完整空闲的对齐块: 大页分配会成功
+    uint64 base = HUGE_ROUND_UP(user_region.begin);
+    for (; base + HUGE_PGSIZE <= user_region.end; base += HUGE_PGSIZE) {
+        int i;
+        for (i = 0; i < HUGE_PAGES; i++) {
+            if (!(pmem_page(base + i * PGSIZE)->flags & PG_FREE))
+                break;
+        }
+        if (i == HUGE_PAGES)
+            return -1;
+    }
+
+    if (runs == 0)
+        return 0;
+    return 1000 - (int)((1000 + free_pages * 1000 / HUGE_PAGES) / runs);
+}
+
+// 迁移一个页面到dst(dst已从空闲链取出), 成功后src被释放
+static bool migrate_page(uint64 src, uint64 dst)
+{
+    if (!rmap_move(src, dst))
+        return false;
+    pmem_free(src, false);
+    return true;
+}
+
+// 从高地址端往下找一个不在[begin, end)内的空闲页并取出, 没有返回0
+// *hand记录上次找到的位置, 每次规整从头开始
+static uint64 take_free(uint64* hand, uint64 begin, uint64 end)
+{
+    while (*hand > user_region.begin) {
+        *hand -= PGSIZE;
+        if (*hand >= begin && *hand < end)
+            continue;
+        if (pmem_take(*hand))
+            return *hand;
+    }
+    return 0;
+}
+
+// 在已用页面全部可迁移的对齐块中, 挑已用页面最少的一个, 没有返回0
+static uint64 pick_block(uint32* used_out)
+{
+    uint64 best = 0;
+    uint32 best_used = HUGE_PAGES;
+
+    uint64 base = HUGE_ROUND_UP(user_region.begin);
+    for (; base + HUGE_PGSIZE <= user_region.end; base += HUGE_PGSIZE) {
+        uint32 used = 0;
+        int i;
+        for (i = 0; i < HUGE_PAGES && used < best_used; i++) {
+            uint64 pa = base + i * PGSIZE;
+            if (pmem_page(pa)->flags & PG_FREE)
+                continue;
+            if (!rmap_movable(pa))
+                break;
+            used++;
+        }
+        if (i == HUGE_PAGES && used < best_used) {
+            best = base;
+            best_used = used;
+        }
+    }
+    *used_out = best_used;
+    return best;
+}
+
+// 持有compact_lk
+static bool compact_huge_locked()
+{
+    stat.frag_before = compact_frag_index();
+    if (stat.frag_before < 0) {
+        stat.frag_after = stat.frag_before;
+        return true;
+    }
+
+    uint32 used;
+    uint64 block = pick_block(&used);
+    bool ok = block != 0 && used <= user_region.allocable;
+    if (ok) {
+        uint64 hand = user_region.end;
+        for (int i = 0; i < HUGE_PAGES && ok; i++) {
+            uint64 pa = block + i * PGSIZE;
+            if (pmem_page(pa)->flags & PG_FREE)
+                continue;
+            uint64 dst = take_free(&hand, block, block + HUGE_PGSIZE);
+            if (dst == 0) {
+                ok = false;
+            } else if (!migrate_page(pa, dst)) {
+                pmem_free(dst, false);
+                ok = false;
+            } else {
+                stat.migrated++;
+            }
+        }
+    }
+
+    if (ok)
+        stat.succeeded++;
+    else
+        stat.failed++;
+    stat.frag_after = compact_frag_index();
+    return ok;
+}
+
+bool compact_huge()
+{
+    spinlock_acquire(&compact_lk);
+    bool ok = compact_huge_locked();
+    spinlock_release(&compact_lk);
+    return ok;
+}
+
+bool compact_try_huge()
+{
+    spinlock_acquire(&compact_lk);
+    // 最近规整失败过: 推迟一段时间, 避免每次大页分配失败都做一次全表扫描
+    if (defer_shift > 0 && defer_count < (1u << defer_shift)) {
+        defer_count++;
+        spinlock_release(&compact_lk);
+        return false;
+    }
+    bool ok = compact_huge_locked();
+    if (ok) {
+        defer_shift = 0;
+    } else if (defer_shift < COMPACT_DEFER_MAX) {
+        defer_shift++;
+    }
+    defer_count = 0;
+    spinlock_release(&compact_lk);
+    return ok;
+}
+
+// kcompactd内核线程: 每COMPACT_INTERVAL个tick检查一次, 碎片严重时主动规整
+void compact_daemon(void* arg)
+{
+    for (;;) {
+        if (compact_frag_index() > COMPACT_PROACTIVE)
+            compact_huge();
+        twheel_sleep(COMPACT_INTERVAL);
+    }
+}
+
+void compact_get_stat(compact_stat_t* st)
+{
+    spinlock_acquire(&compact_lk);
+    *st = stat;
+    spinlock_release(&compact_lk);
+}
@@ -0,0 +1,51 @@
+#include "mem/kcache.h"
+#include "mem/pmem.h"
+
+void kcache_init(kcache_t* c, char* name, uint32 size)
+{
+    spinlock_init(&c->lk, name);
+    c->name = name;
+    c->size = (size + 7) & ~7u;
+    assert(c->size <= PGSIZE, "kcache_init: object too big");
+    c->free = NULL;
+    c->total = 0;
+    c->nfree = 0;
+}
+
+// 空闲链为空时切出一个新页面 (持有c->lk)
+static bool kcache_grow(kcache_t* c)
+{
+    char* page = (char*)pmem_alloc(true);
+    if (page == NULL)
+        return false;
+    for (uint32 off = 0; off + c->size <= PGSIZE; off += c->size) {
+        *(void**)(page + off) = c->free;
+        c->free = page + off;
+        c->total++;
+        c->nfree++;
+    }
+    return true;
+}
+
+void* kcache_alloc(kcache_t* c)
+{
+    spinlock_acquire(&c->lk);
+    if (c->free == NULL && !kcache_grow(c)) {
+        spinlock_release(&c->lk);
+        return NULL;
+    }
+    void* obj = c->free;
+    c->free = *(void**)obj;
+    c->nfree--;
+    spinlock_release(&c->lk);
+    return obj;
+}
+
+void kcache_free(kcache_t* c, void* obj)
+{
+    spinlock_acquire(&c->lk);
+    *(void**)obj = c->free;
+    c->free = obj;
+    c->nfree++;
+    spinlock_release(&c->lk);
+}
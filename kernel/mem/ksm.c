@@ -0,0 +1,222 @@
+#include "mem/ksm.h"
+#include "mem/pmem.h"
+#include "mem/vmem.h"
+#include "proc/proc.h"
+#include "dev/twheel.h"
+#include "lib/print.h"
+#include "riscv.h"
+
+static spinlock_t ksm_lk;                  // 保护下面所有字段
+static uint64 stable[KSM_TABLE_SIZE];      // 共享页面的物理地址
+static uint64 unstable[KSM_TABLE_SIZE];    // 合并候选私有页面的物理地址
+static uint32 scan_hand;                   // 扫描指针(user_region中的页序号)
+static uint64 pages_scanned;
+static uint64 full_scans;
+
+void ksm_init()
+{
+    spinlock_init(&ksm_lk, "ksm");
+}
+
+// 页面内容校验和(FNV-1a)
+static uint32 page_hash(uint64 pa)
+{
+    uint32* w = (uint32*)pa;
+    uint32 h = 2166136261u;
+    for (int i = 0; i < PGSIZE / sizeof(uint32); i++) {
+        h ^= w[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// 可写页面改为写时复制, 只读页面保持不变
+static pte_t wrprotect(pte_t pte)
+{
+    if (pte & PTE_W)
+        pte = (pte & ~PTE_W) | PTE_COW;
+    return pte;
+}
+
+// 私有页面在其唯一映射者页表中的PTE, 不满足合并条件返回NULL
+static pte_t* private_pte(page_t* pg, uint64 pa)
+{
+    if ((pg->flags & (PG_FREE | PG_KSM)) || pg->ref != 1)
+        return NULL;
+    pte_t* pte = rmap_private_pte(pa);
+    if (pte == NULL || !(*pte & PTE_U))
+        return NULL;
+    return pte;
+}
+
+// 表项是否仍然有效, 失效的表项可以被新页面复用
+static bool entry_live(uint64* table, uint64 pa)
+{
+    if (pa == 0)
+        return false;
+    page_t* pg = pmem_page(pa);
+    if (table == stable)
+        return (pg->flags & PG_KSM) != 0;
+    return !(pg->flags & (PG_FREE | PG_KSM)) && pg->rmap.pgtbl != NULL;
+}
+
+static void table_insert(uint64* table, uint64 pa, uint32 hash)
+{
+    for (int i = 0; i < KSM_PROBE; i++) {
+        uint64* slot = &table[(hash + i) % KSM_TABLE_SIZE];
+        if (!entry_live(table, *slot)) {
+            *slot = pa;
+            return;
+        }
+    }
+    // 探测范围内都被占用, 放弃这个页面(下一轮还有机会)
+}
+
+// 在稳定表中找内容与pa相同的共享页面
+static uint64 stable_find(uint64 pa, uint32 hash)
+{
+    for (int i = 0; i < KSM_PROBE; i++) {
+        uint64 kpa = stable[(hash + i) % KSM_TABLE_SIZE];
+        if (kpa == 0 || kpa == pa)
+            continue;
+        page_t* kpg = pmem_page(kpa);
+        if ((kpg->flags & PG_KSM) && kpg->hash == hash
+            && memcmp((void*)kpa, (void*)pa, PGSIZE) == 0)
+            return kpa;
+    }
+    return 0;
+}
+
+// 在不稳定表中找内容与pa相同的私有页面(pa的映射者owner已被固定)
+// 找到时该页面已被写保护, 可以直接提升为共享页面
+// 它的映射者与owner不同时保持固定并通过*qowner返回, 由调用者解除
+static uint64 unstable_find(uint64 pa, uint32 hash, proc_t* owner, proc_t** qowner)
+{
+    for (int i = 0; i < KSM_PROBE; i++) {
+        uint64 qpa = unstable[(hash + i) % KSM_TABLE_SIZE];
+        if (qpa == 0 || qpa == pa)
+            continue;
+        page_t* qpg = pmem_page(qpa);
+        if (qpg->hash != hash)
+            continue;
+        proc_t* q = NULL;
+        if (qpg->rmap.pgtbl != owner->pgtbl && (q = proc_pin(qpg->rmap.pgtbl)) == NULL)
+            continue;
+        pte_t* qpte = private_pte(qpg, qpa);
+        pgtbl_t pinned = q != NULL ? q->pgtbl : owner->pgtbl;
+        if (qpte != NULL && qpg->rmap.pgtbl == pinned && qpg->hash == hash) {
+            // 先写保护再比较, 保证比较之后内容不会再被改写
+            pte_t old = *qpte;
+            *qpte = wrprotect(old);
+            sfence_vma();
+            if (memcmp((void*)qpa, (void*)pa, PGSIZE) == 0) {
+                *qowner = q;
+                return qpa;
+            }
+            *qpte = old;
+            sfence_vma();
+        }
+        if (q != NULL)
+            proc_unpin(q);
+    }
+    return 0;
+}
+
+// 扫描一个物理页, 能合并就合并
+// 改写PTE期间映射者被固定, 不会在其他CPU上运行
+static void scan_page(uint64 pa)
+{
+    page_t* pg = pmem_page(pa);
+    if ((pg->flags & (PG_FREE | PG_KSM)) || pg->ref != 1)
+        return;
+    proc_t* owner = proc_pin(pg->rmap.pgtbl);
+    if (owner == NULL)
+        return;
+    pte_t* pte = private_pte(pg, pa);
+    if (pte == NULL || pg->rmap.pgtbl != owner->pgtbl) {
+        proc_unpin(owner);
+        return;
+    }
+
+    // 内容还在变化, 记下校验和, 下一轮再看
+    uint32 hash = page_hash(pa);
+    if (hash != pg->hash) {
+        pg->hash = hash;
+        proc_unpin(owner);
+        return;
+    }
+
+    pte_t old = *pte;
+    *pte = wrprotect(old);
+    sfence_vma();
+
+    proc_t* qowner = NULL;
+    uint64 kpa = stable_find(pa, hash);
+    if (kpa == 0 && (kpa = unstable_find(pa, hash, owner, &qowner)) != 0) {
+        // 两个私有页面内容相同: 把先扫描到的那个提升为共享页面
+        page_t* kpg = pmem_page(kpa);
+        kpg->flags |= PG_KSM;
+        table_insert(stable, kpa, hash);
+    }
+
+    // 把这个映射改指向共享页面, 释放原来的私有页面
+    // 共享页面可能刚被最后一个映射者收回, 这时放弃合并
+    if (kpa != 0 && rmap_merge(pa, kpa)) {
+        pmem_free(pa, false);
+    } else {
+        // 没有相同的页面, 恢复写权限并登记为候选
+        *pte = old;
+        if (kpa == 0)
+            table_insert(unstable, pa, hash);
+    }
+    sfence_vma();
+
+    if (qowner != NULL)
+        proc_unpin(qowner);
+    proc_unpin(owner);
+}
+
+// 扫描下一批页面
+// 每扫描一个页面就释放一次ksm_lk, 避免整批扫描期间一直关中断
+void ksm_scan()
+{
+    uint32 total = (user_region.end - user_region.begin) / PGSIZE;
+    for (int i = 0; i < KSM_SCAN_PAGES; i++) {
+        spinlock_acquire(&ksm_lk);
+        scan_page(user_region.begin + (uint64)scan_hand * PGSIZE);
+        pages_scanned++;
+        if (++scan_hand == total) {
+            // 一轮结束, 不稳定表里的候选可能早已变化, 全部作废
+            scan_hand = 0;
+            full_scans++;
+            memset(unstable, 0, sizeof(unstable));
+        }
+        spinlock_release(&ksm_lk);
+    }
+}
+
+// ksmd内核线程: 每KSM_SCAN_TICKS个tick扫描一批页面
+void ksm_daemon(void* arg)
+{
+    for (;;) {
+        ksm_scan();
+        twheel_sleep(KSM_SCAN_TICKS);
+    }
+}
+
+void ksm_get_stat(ksm_stat_t* st)
+{
+    spinlock_acquire(&ksm_lk);
+    st->pages_shared = 0;
+    st->pages_sharing = 0;
+    for (uint64 pa = user_region.begin; pa < user_region.end; pa += PGSIZE) {
+        page_t* pg = pmem_page(pa);
+        if (pg->flags & PG_KSM) {
+            st->pages_shared++;
+            st->pages_sharing += pg->ref - 1;
+        }
+    }
+    st->pages_scanned = pages_scanned;
+    st->full_scans = full_scans;
+    spinlock_release(&ksm_lk);
+}
@@ -0,0 +1,86 @@
+#include "mem/kstack.h"
+#include "mem/pmem.h"
+#include "mem/vmem.h"
+#include "memlayout.h"
+#include "riscv.h"
+
+extern pgtbl_t kernel_pgtbl;
+
+static spinlock_t kstack_lk;            // 保护下面所有字段以及对内核页表KSTACK区域的修改
+static bool   slot_used[KSTACK_SLOTS];  // 槽是否已映射(正在使用或位于缓存中)
+static uint64 cache[KSTACK_CACHE];      // 保持映射的空闲内核栈
+static uint32 ncache;
+static int    slot_hint;                // 下次从这里开始搜索空闲槽
+
+void kstack_init()
+{
+    spinlock_init(&kstack_lk, "kstack");
+}
+
+// 给空闲的槽分配物理页并映射, 槽下方的保护页保持不映射 (持有kstack_lk)
+// 内存不足时返回0
+static uint64 slot_map(int slot)
+{
+    uint64 kstack = KSTACK(slot);
+    uint64 pa[KSTACK_PAGES];
+    for (int i = 0; i < KSTACK_PAGES; i++) {
+        pa[i] = (uint64)pmem_alloc(true);
+        if (pa[i] == 0) {
+            while (i > 0)
+                pmem_free(pa[--i], true);
+            return 0;
+        }
+    }
+    for (int i = 0; i < KSTACK_PAGES; i++)
+        vm_mappages(kernel_pgtbl, kstack + i * PGSIZE, pa[i], PGSIZE, PTE_R | PTE_W);
+    slot_used[slot] = true;
+    return kstack;
+}
+
+uint64 kstack_alloc()
+{
+    uint64 kstack = 0;
+    spinlock_acquire(&kstack_lk);
+    if (ncache > 0) {
+        kstack = cache[--ncache];
+    } else {
+        for (int i = 0; i < KSTACK_SLOTS; i++) {
+            int slot = (slot_hint + i) % KSTACK_SLOTS;
+            if (!slot_used[slot]) {
+                kstack = slot_map(slot);
+                if (kstack != 0)
+                    slot_hint = slot + 1;
+                break;
+            }
+        }
+    }
+    spinlock_release(&kstack_lk);
+    return kstack;
+}
+
+/*
+    缓存满时解除映射并归还物理页
+    其他CPU的TLB里可能还留着这个槽的旧映射, 所以调度器切换到进程之前总会刷新TLB
+    (见proc_scheduler), 槽被重新映射之后不会有CPU通过旧映射访问已归还的物理页
+*/
+void kstack_free(uint64 kstack)
+{
+    int slot = kstack_slot(kstack);
+
+    spinlock_acquire(&kstack_lk);
+    assert(slot_used[slot], "kstack_free: not used");
+    if (ncache < KSTACK_CACHE) {
+        cache[ncache++] = kstack;
+    } else {
+        vm_unmappages(kernel_pgtbl, kstack, KSTACK_SIZE, true);
+        slot_used[slot] = false;
+    }
+    spinlock_release(&kstack_lk);
+}
+
+int kstack_slot(uint64 kstack)
+{
+    int slot = (kstack - KSTACK(0)) / (KSTACK_SIZE + PGSIZE);
+    assert(slot >= 0 && slot < KSTACK_SLOTS && KSTACK(slot) == kstack, "kstack_slot");
+    return slot;
+}
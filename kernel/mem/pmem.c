@@ -1,5 +1,36 @@
 #include "mem/pmem.h"
 alloc_region_t kern_region, user_region;
+
+// user_region里每个物理页的描述符
+static page_t pages[USER_PAGES];
+
+page_t* pmem_page(uint64 pa)
+{
+    if (pa < user_region.begin || pa >= user_region.end)
+        return NULL;
+    return &pages[(pa - user_region.begin) / PGSIZE];
+}
+
+// 从空闲链中摘除node(调用者持有region->lk)
+static void list_remove(alloc_region_t* region, page_node_t* node)
+{
+    node->prev->next = node->next;
+    if (node->next)
+        node->next->prev = node->prev;
+    region->allocable--;
+}
+
+// 把node插入空闲链头部(调用者持有region->lk)
+static void list_push(alloc_region_t* region, page_node_t* node)
+{
+    node->next = region->list_head.next;
+    node->prev = &region->list_head;
+    if (node->next)
+        node->next->prev = node;
+    region->list_head.next = node;
+    region->allocable++;
+}
+
 void pmem_init(void)
 {
     spinlock_init(&kern_region.lk, "kern_region");
@@ -12,26 +43,38 @@ void pmem_init(void)
     user_region.allocable = (user_region.end - user_region.begin) / PGSIZE;
     // 用page_node_t结构体管理每个物理页
     uint64 page_addr = kern_region.begin;
+    page_node_t* prev = &kern_region.list_head;
     for (int i = 0; i < kern_region.allocable; i++) {
         page_node_t* node = (page_node_t*)page_addr;
+        node->prev = prev;
         if (i == kern_region.allocable - 1) {
             node->next = NULL;
         } else {
             node->next = (page_node_t*)(page_addr + PGSIZE);
         }
+        prev = node;
         page_addr += PGSIZE;
     }
     kern_region.list_head.next = (page_node_t*)kern_region.begin;
 
     // user_region同理
     page_addr = user_region.begin;
+    prev = &user_region.list_head;
     for (int i = 0; i < user_region.allocable; i++) {
         page_node_t* node = (page_node_t*)page_addr;
+        node->prev = prev;
         if (i == user_region.allocable - 1) {
             node->next = NULL;
         } else {
             node->next = (page_node_t*)(page_addr + PGSIZE);
         }
+        pages[i].flags = PG_FREE;
+        pages[i].age = 0;
+        pages[i].ref = 0;
+        pages[i].hash = 0;
+        pages[i].rmap.pgtbl = NULL;
+        pages[i].rmap.next = NULL;
+        prev = node;
         page_addr += PGSIZE;
     }
     user_region.list_head.next = (page_node_t*)user_region.begin;
@@ -45,21 +88,156 @@ void* pmem_alloc(bool in_kernel)
         return NULL;
     }
     page_node_t* node = region->list_head.next;
-    region->list_head.next = node->next;
-    region->allocable--;
+    list_remove(region, node);
+    if (!in_kernel) {
+        page_t* pg = pmem_page((uint64)node);
+        pg->flags = 0;
+        pg->age = 0;
+        pg->ref = 1;
+        pg->hash = 0;
+    }
     spinlock_release(&region->lk);
     return (void*)node;
 }
 void pmem_free(uint64 page, bool in_kernel)
 {
     alloc_region_t* region = in_kernel ? &kern_region : &user_region;
-    //if (page < region->begin || page >= region->end || page % PGSIZE != 0) {
-    //    panic("pmem_free");
-    //}
+    if (page < region->begin || page >= region->end || page % PGSIZE != 0) {
+        panic("pmem_free");
+    }
     spinlock_acquire(&region->lk);
-    page_node_t* node = (page_node_t*)page;
-    node->next = region->list_head.next;
-    region->list_head.next = node;
-    region->allocable++;
+    if (!in_kernel) {
+        page_t* pg = pmem_page(page);
+        if (pg->flags & PG_FREE)
+            panic("pmem_free: double free");
+        // 共享页面只减少引用计数, 最后一个映射者释放时才回到空闲链
+        if (--pg->ref > 0) {
+            spinlock_release(&region->lk);
+            return;
+        }
+        if (pg->rmap.pgtbl != NULL)
+            panic("pmem_free: page still mapped");
+        pg->flags = PG_FREE;
+    }
+    list_push(region, (page_node_t*)page);
     spinlock_release(&region->lk);
-}
\ No newline at end of file
+}
+
+// 申请一个2MiB对齐且物理连续的大页(只在user_region中分配)
+// 没有满足条件的连续空闲块时返回NULL, 调用者应退回到4KiB页面
+void* pmem_alloc_huge(void)
+{
+    uint64 huge_size = (uint64)HUGE_PAGES * PGSIZE;
+    uint64 base = (user_region.begin + huge_size - 1) & ~(huge_size - 1);
+
+    spinlock_acquire(&user_region.lk);
+    while (base + huge_size <= user_region.end) {
+        // 检查这512个页面是否全部空闲, 遇到已分配页面时直接跳到下一个对齐块
+        int i;
+        for (i = 0; i < HUGE_PAGES; i++) {
+            if (!(pmem_page(base + i * PGSIZE)->flags & PG_FREE))
+                break;
+        }
+        if (i == HUGE_PAGES) {
+            for (i = 0; i < HUGE_PAGES; i++) {
+                uint64 pa = base + i * PGSIZE;
+                list_remove(&user_region, (page_node_t*)pa);
+                pmem_page(pa)->flags = 0;
+                pmem_page(pa)->age = 0;
+                pmem_page(pa)->ref = 1;
+                pmem_page(pa)->hash = 0;
+            }
+            spinlock_release(&user_region.lk);
+            return (void*)base;
+        }
+        base += huge_size;
+    }
+    spinlock_release(&user_region.lk);
+    return NULL;
+}
+
+// 释放一个大页, 512个页面各自回到空闲链
+// 大页被拆分后也可以逐页用pmem_free释放
+void pmem_free_huge(uint64 page)
+{
+    for (int i = 0; i < HUGE_PAGES; i++)
+        pmem_free(page + i * PGSIZE, false);
+}
+
+// 增加一个user_region页面的引用计数(页面被又一个PTE共享)
+void pmem_get(uint64 page)
+{
+    page_t* pg = pmem_page(page);
+    if (pg == NULL || (pg->flags & PG_FREE))
+        panic("pmem_get");
+    spinlock_acquire(&user_region.lk);
+    pg->ref++;
+    spinlock_release(&user_region.lk);
+}
+
+// 页面没有空闲时增加它的引用计数(回收挑选页面时使用, 页面随时可能被释放)
+// 页面已经空闲时返回false
+bool pmem_tryget(uint64 page)
+{
+    page_t* pg = pmem_page(page);
+    if (pg == NULL)
+        return false;
+    spinlock_acquire(&user_region.lk);
+    bool ok = !(pg->flags & PG_FREE);
+    if (ok)
+        pg->ref++;
+    spinlock_release(&user_region.lk);
+    return ok;
+}
+
+// 从空闲链中取出指定的user_region页面(内存规整挑选迁移目标时使用)
+// 页面不空闲时返回false
+bool pmem_take(uint64 page)
+{
+    page_t* pg = pmem_page(page);
+    if (pg == NULL)
+        return false;
+    spinlock_acquire(&user_region.lk);
+    if (!(pg->flags & PG_FREE)) {
+        spinlock_release(&user_region.lk);
+        return false;
+    }
+    list_remove(&user_region, (page_node_t*)page);
+    pg->flags = 0;
+    pg->age = 0;
+    pg->ref = 1;
+    pg->hash = 0;
+    spinlock_release(&user_region.lk);
+    return true;
+}
+
+// 共享页面又多了一个映射者: 引用计数加一
+// 页面已经不再共享(PG_KSM被清除)时返回false
+bool pmem_share(uint64 page)
+{
+    page_t* pg = pmem_page(page);
+    if (pg == NULL)
+        return false;
+    spinlock_acquire(&user_region.lk);
+    bool ok = (pg->flags & PG_KSM) != 0;
+    if (ok)
+        pg->ref++;
+    spinlock_release(&user_region.lk);
+    return ok;
+}
+
+// 共享页面只剩调用者一个映射者时把它收回为私有页面(清除PG_KSM)
+// 还有其他映射者时返回false, 调用者应复制一份
+// 与pmem_share在同一把锁下判断, 收回之后不会再有新的映射者加入
+bool pmem_unshare(uint64 page)
+{
+    page_t* pg = pmem_page(page);
+    if (pg == NULL)
+        return false;
+    spinlock_acquire(&user_region.lk);
+    bool ok = pg->ref == 1;
+    if (ok)
+        pg->flags &= ~PG_KSM;
+    spinlock_release(&user_region.lk);
+    return ok;
+}
@@ -0,0 +1,324 @@
+#include "mem/rmap.h"
+#include "mem/pmem.h"
+#include "proc/proc.h"
+#include "lib/print.h"
+#include "riscv.h"
+
+static spinlock_t rmap_lk;    // 保护所有页描述符的rmap链和空闲节点链
+static rmap_t* free_nodes;    // 空闲的rmap节点
+
+void rmap_init()
+{
+    spinlock_init(&rmap_lk, "rmap");
+}
+
+// 申请一个rmap节点, 空闲链为空时切分一个内核页 (持有rmap_lk)
+static rmap_t* node_alloc()
+{
+    if (free_nodes == NULL) {
+        rmap_t* page = (rmap_t*)pmem_alloc(true);
+        if (page == NULL)
+            panic("rmap: out of kernel pages");
+        for (int i = 0; i < PGSIZE / sizeof(rmap_t); i++) {
+            page[i].next = free_nodes;
+            free_nodes = &page[i];
+        }
+    }
+    rmap_t* node = free_nodes;
+    free_nodes = node->next;
+    return node;
+}
+
+static void node_free(rmap_t* node)
+{
+    node->next = free_nodes;
+    free_nodes = node;
+}
+
+void rmap_add(uint64 pa, pgtbl_t pgtbl, uint64 va)
+{
+    page_t* pg = pmem_page(pa);
+    if (pg == NULL)
+        return;
+
+    spinlock_acquire(&rmap_lk);
+    if (pg->rmap.pgtbl == NULL) {
+        pg->rmap.pgtbl = pgtbl;
+        pg->rmap.va = va;
+    } else {
+        rmap_t* node = node_alloc();
+        node->pgtbl = pgtbl;
+        node->va = va;
+        node->next = pg->rmap.next;
+        pg->rmap.next = node;
+    }
+    spinlock_release(&rmap_lk);
+}
+
+void rmap_remove(uint64 pa, pgtbl_t pgtbl, uint64 va)
+{
+    page_t* pg = pmem_page(pa);
+    if (pg == NULL)
+        return;
+
+    spinlock_acquire(&rmap_lk);
+    if (pg->rmap.pgtbl == pgtbl && pg->rmap.va == va) {
+        // 撤销内联的映射: 把链上第一个节点提上来
+        rmap_t* node = pg->rmap.next;
+        if (node != NULL) {
+            pg->rmap = *node;
+            node_free(node);
+        } else {
+            pg->rmap.pgtbl = NULL;
+        }
+    } else {
+        rmap_t** pp = &pg->rmap.next;
+        while (*pp != NULL && ((*pp)->pgtbl != pgtbl || (*pp)->va != va))
+            pp = &(*pp)->next;
+        if (*pp == NULL)
+            panic("rmap_remove: not mapped");
+        rmap_t* node = *pp;
+        *pp = node->next;
+        node_free(node);
+    }
+    spinlock_release(&rmap_lk);
+}
+
+// pa只被一个4KiB PTE映射时返回这个PTE, 否则返回NULL(没有映射、多个映射或位于大页内)
+pte_t* rmap_private_pte(uint64 pa)
+{
+    page_t* pg = pmem_page(pa);
+    if (pg == NULL)
+        return NULL;
+
+    pte_t* pte = NULL;
+    spinlock_acquire(&rmap_lk);
+    if (pg->rmap.pgtbl != NULL && pg->rmap.next == NULL
+        && vm_gethuge(pg->rmap.pgtbl, pg->rmap.va) == NULL) {
+        pte = vm_getpte(pg->rmap.pgtbl, pg->rmap.va, false);
+        if (pte != NULL && (!(*pte & PTE_V) || PTE_TO_PA(*pte) != pa))
+            pte = NULL;
+    }
+    spinlock_release(&rmap_lk);
+    return pte;
+}
+
+// 检查一个映射是否可以迁移: 4KiB PTE且确实指向pa (持有rmap_lk)
+static pte_t* movable_pte(rmap_t* r, uint64 pa)
+{
+    if (vm_gethuge(r->pgtbl, r->va) != NULL)
+        return NULL;
+    pte_t* pte = vm_getpte(r->pgtbl, r->va, false);
+    if (pte == NULL || !(*pte & PTE_V) || PTE_TO_PA(*pte) != pa)
+        return NULL;
+    return pte;
+}
+
+// pa的所有映射都是4KiB PTE且映射数等于引用计数时, 页面可以迁移
+// (换出途中的页面没有映射, 大页不拆分, 都不可迁移)
+bool rmap_movable(uint64 pa)
+{
+    page_t* pg = pmem_page(pa);
+    if (pg == NULL || (pg->flags & PG_FREE))
+        return false;
+
+    uint32 n = 0;
+    bool ok = true;
+    spinlock_acquire(&rmap_lk);
+    for (rmap_t* r = &pg->rmap; r != NULL && r->pgtbl != NULL; r = r->next) {
+        if (movable_pte(r, pa) == NULL) {
+            ok = false;
+            break;
+        }
+        n++;
+    }
+    spinlock_release(&rmap_lk);
+    return ok && n > 0 && n == pg->ref;
+}
+
+// 一次迁移或解除映射最多固定的地址空间数, 共享者更多的页面不处理
+#define MOVE_PIN_MAX 32
+
+// 固定pa的所有映射者 (持有rmap_lk)
+// 同一个进程可能多次映射同一个页面, 只固定一次; 有映射者无法固定时全部解除并返回-1
+static int pin_mappers(page_t* pg, proc_t** pinned)
+{
+    int n = 0;
+    for (rmap_t* r = &pg->rmap; r != NULL && r->pgtbl != NULL; r = r->next) {
+        int i;
+        for (i = 0; i < n && pinned[i]->pgtbl != r->pgtbl; i++)
+            ;
+        if (i < n)
+            continue;
+        if (n == MOVE_PIN_MAX || (pinned[n] = proc_pin(r->pgtbl)) == NULL) {
+            while (n > 0)
+                proc_unpin(pinned[--n]);
+            return -1;
+        }
+        n++;
+    }
+    return n;
+}
+
+// 把src迁移到dst: 拷贝页面内容, 所有映射改指向dst, 页描述符的状态随之转移
+// 迁移期间所有映射者都被固定, 不会有CPU在拷贝时写入src
+// 有映射不可迁移、映射者无法固定或有映射正在变化时返回false且不做任何修改
+bool rmap_move(uint64 src, uint64 dst)
+{
+    page_t* spg = pmem_page(src);
+    page_t* dpg = pmem_page(dst);
+    if (spg == NULL || dpg == NULL || dpg->rmap.pgtbl != NULL)
+        return false;
+
+    proc_t* pinned[MOVE_PIN_MAX];
+    spinlock_acquire(&rmap_lk);
+    int npinned = pin_mappers(spg, pinned);
+    if (npinned < 0) {
+        spinlock_release(&rmap_lk);
+        return false;
+    }
+    bool ok = true;
+    uint32 n = 0;
+    for (rmap_t* r = &spg->rmap; r != NULL && r->pgtbl != NULL; r = r->next, n++) {
+        if (movable_pte(r, src) == NULL)
+            ok = false;
+    }
+
+    spinlock_acquire(&user_region.lk);
+    // 引用计数与映射数不一致说明有映射正在建立或撤销(如写时复制的中途)
+    if (ok && n > 0 && n == spg->ref) {
+        memmove((void*)dst, (void*)src, PGSIZE);
+        for (rmap_t* r = &spg->rmap; r != NULL && r->pgtbl != NULL; r = r->next) {
+            pte_t* pte = vm_getpte(r->pgtbl, r->va, false);
+            *pte = PA_TO_PTE(dst) | PTE_FLAGS(*pte);
+        }
+        dpg->rmap = spg->rmap;
+        dpg->flags |= spg->flags & PG_KSM;
+        dpg->age = spg->age;
+        dpg->hash = spg->hash;
+        dpg->ref = spg->ref;
+        spg->rmap.pgtbl = NULL;
+        spg->rmap.next = NULL;
+        spg->flags &= ~PG_KSM;
+        spg->ref = 1;
+    } else {
+        ok = false;
+    }
+    spinlock_release(&user_region.lk);
+    while (npinned > 0)
+        proc_unpin(pinned[--npinned]);
+    spinlock_release(&rmap_lk);
+
+    if (ok)
+        sfence_vma();
+    return ok;
+}
+
+// 检查pa的所有映射最近是否被访问过, 同时清除它们的A位(调用者负责sfence)
+// 映射者正在其他CPU上运行、无法固定时也返回true
+bool rmap_referenced(uint64 pa)
+{
+    page_t* pg = pmem_page(pa);
+    if (pg == NULL)
+        return false;
+
+    proc_t* pinned[MOVE_PIN_MAX];
+    spinlock_acquire(&rmap_lk);
+    int npinned = pin_mappers(pg, pinned);
+    if (npinned < 0) {
+        spinlock_release(&rmap_lk);
+        return true;
+    }
+    bool young = false;
+    for (rmap_t* r = &pg->rmap; r != NULL && r->pgtbl != NULL; r = r->next) {
+        pte_t* pte = vm_getpte(r->pgtbl, r->va, false);
+        if (pte != NULL && (*pte & PTE_V) && (*pte & PTE_A)) {
+            *pte &= ~PTE_A;
+            young = true;
+        }
+    }
+    while (npinned > 0)
+        proc_unpin(pinned[--npinned]);
+    spinlock_release(&rmap_lk);
+    return young;
+}
+
+// 解除pa的所有映射, 每个映射释放一次页面引用, 返回解除的映射数
+// pte为0时清除PTE, 否则每个PTE改写为pte并保留原来的R W X U和COW位(如换出时写入交换项)
+// 改写期间所有映射者都被固定; 有映射位于大页内或映射者无法固定时不做任何修改, 返回0
+uint32 rmap_unmap_all(uint64 pa, pte_t pte)
+{
+    page_t* pg = pmem_page(pa);
+    if (pg == NULL || (pg->flags & PG_FREE))
+        return 0;
+
+    proc_t* pinned[MOVE_PIN_MAX];
+    spinlock_acquire(&rmap_lk);
+    int npinned = pin_mappers(pg, pinned);
+    if (npinned < 0) {
+        spinlock_release(&rmap_lk);
+        return 0;
+    }
+    uint32 n = 0;
+    for (rmap_t* r = &pg->rmap; r != NULL && r->pgtbl != NULL; r = r->next) {
+        if (movable_pte(r, pa) == NULL) {
+            n = 0;
+            break;
+        }
+        n++;
+    }
+    if (n > 0) {
+        uint64 keep = PTE_R | PTE_W | PTE_X | PTE_U | PTE_COW;
+        for (rmap_t* r = &pg->rmap; r != NULL && r->pgtbl != NULL; r = r->next) {
+            pte_t* old = vm_getpte(r->pgtbl, r->va, false);
+            *old = pte != 0 ? (pte | (*old & keep)) : 0;
+        }
+        // 映射全部撤销, 链上的节点一并回收
+        rmap_t* node = pg->rmap.next;
+        while (node != NULL) {
+            rmap_t* next = node->next;
+            node_free(node);
+            node = next;
+        }
+        pg->rmap.pgtbl = NULL;
+        pg->rmap.next = NULL;
+    }
+    while (npinned > 0)
+        proc_unpin(pinned[--npinned]);
+    spinlock_release(&rmap_lk);
+
+    if (n > 0)
+        sfence_vma();
+    for (uint32 i = 0; i < n; i++)
+        pmem_free(pa, false);
+    return n;
+}
+
+// 把私有页面pa唯一的映射改指向共享页面kpa, kpa的引用计数加一
+// kpa在此之前已不再共享(最后一个映射者解除了共享)时返回false且不做任何修改
+// 与rmap_move在rmap_lk下互斥, 迁移途中的共享页面不会多出映射
+bool rmap_merge(uint64 pa, uint64 kpa)
+{
+    page_t* pg = pmem_page(pa);
+    page_t* kpg = pmem_page(kpa);
+
+    spinlock_acquire(&rmap_lk);
+    if (!pmem_share(kpa)) {
+        spinlock_release(&rmap_lk);
+        return false;
+    }
+    pte_t* pte = vm_getpte(pg->rmap.pgtbl, pg->rmap.va, false);
+    *pte = PA_TO_PTE(kpa) | PTE_FLAGS(*pte);
+    if (kpg->rmap.pgtbl == NULL) {
+        kpg->rmap = pg->rmap;
+    } else {
+        rmap_t* node = node_alloc();
+        *node = pg->rmap;
+        node->next = kpg->rmap.next;
+        kpg->rmap.next = node;
+    }
+    pg->rmap.pgtbl = NULL;
+    pg->rmap.next = NULL;
+    spinlock_release(&rmap_lk);
+    return true;
+}
@@ -0,0 +1,236 @@
+#include "mem/swap.h"
+#include "mem/zswap.h"
+#include "mem/wss.h"
+#include "mem/pmem.h"
+#include "mem/vmem.h"
+#include "fs/fs.h"
+#include "dev/vio.h"
+#include "proc/cpu.h"
+#include "proc/proc.h"
+#include "lib/print.h"
+#include "riscv.h"
+
+extern super_block_t sb;
+
+/*
+    页面回收采用时钟(clock)算法:
+    指针在user_region的物理页上循环扫描, 通过反向映射找到PTE
+    A位为1说明最近被访问过, 清除A位给它第二次机会; A位为0的页面被选为换出对象
+    工作集估计记录的空闲年龄决定扫描顺序: 先找冷页面, 找不够再逐步放宽
+    一批选中的页面先改写PTE为交换项, 再逐页压缩进压缩池或写回磁盘, 最后释放物理页
+
+    同页合并共享的页面也可以换出: rmap_unmap_all把所有映射者的PTE改写为同一个交换项
+    交换槽因此带有引用计数, 最后一个交换项被换入或丢弃时才释放
+*/
+
+// 换出途中的页面(交换缓存)
+// 写回磁盘完成之前, 缺页可以直接从这里取回物理页而不必读盘
+// 缓存持有物理页和交换槽各一个引用, 写回完成后一起释放
+typedef struct swap_cache {
+    uint32 slot;     // 交换槽
+    uint64 pa;       // 正在写回的物理页
+} swap_cache_t;
+
+static spinlock_t swap_lk;                  // 保护下面所有字段
+static uint32 swap_start;                   // 交换区起始block
+static uint32 nslots;                       // 可用槽数量, 0表示没有交换区
+static uint16 slot_ref[SWAP_SLOTS_MAX];     // 槽的引用数: 指向它的交换项加上交换缓存, 0表示空闲
+static uint32 slot_hint;                    // 下次从这里开始搜索空闲槽
+static uint32 clock_hand;                   // 时钟指针(user_region中的页序号)
+static bool   reclaiming;                   // 是否有一批页面正在写回
+static swap_cache_t cache[SWAP_BATCH];
+static uint32 ncache;
+
+// 交换区初始化
+// 依赖超级块, 所以必须在fs_init之后调用
+void swap_init()
+{
+    spinlock_init(&swap_lk, "swap");
+    zswap_init();
+    swap_start = sb.swap_start;
+    nslots = sb.swap_blocks / SWAP_BLOCKS_PER_PAGE;
+    if (nslots > SWAP_SLOTS_MAX)
+        nslots = SWAP_SLOTS_MAX;
+    printf("swap: %d slots from block %d\n", nslots, swap_start);
+}
+
+// 申请一个交换槽, 引用数为1, 失败返回-1 (持有swap_lk)
+static int slot_alloc()
+{
+    for (uint32 i = 0; i < nslots; i++) {
+        uint32 s = (slot_hint + i) % nslots;
+        if (slot_ref[s] == 0) {
+            slot_ref[s] = 1;
+            slot_hint = s + 1;
+            return s;
+        }
+    }
+    return -1;
+}
+
+// 释放交换槽的一个引用, 最后一个引用释放时槽被回收 (持有swap_lk)
+static void slot_put(uint32 s)
+{
+    assert(s < nslots && slot_ref[s] > 0, "slot_put");
+    if (--slot_ref[s] == 0)
+        zswap_invalidate(s);
+}
+
+// 在交换缓存中查找slot (持有swap_lk)
+static swap_cache_t* cache_lookup(uint32 slot)
+{
+    for (uint32 i = 0; i < ncache; i++) {
+        if (cache[i].slot == slot)
+            return &cache[i];
+    }
+    return NULL;
+}
+
+// 时钟指针扫描最多limit个页面, 把空闲年龄不小于min_age的页面加入交换缓存
+// 直到缓存中有npages个页面 (持有swap_lk)
+static void pick_victims(uint32 npages, uint32 min_age, uint32 limit)
+{
+    uint32 total = (user_region.end - user_region.begin) / PGSIZE;
+    for (uint32 scanned = 0; ncache < npages && scanned < limit; scanned++) {
+        uint64 pa = user_region.begin + (uint64)clock_hand * PGSIZE;
+        clock_hand = (clock_hand + 1) % total;
+
+        // 没有映射的页面(如正在写回的页面)不参与换出, 大页由rmap_unmap_all拒绝
+        page_t* pg = pmem_page(pa);
+        if ((pg->flags & PG_FREE) || pg->rmap.pgtbl == NULL || pg->age < min_age)
+            continue;
+        // 最近被访问过: 清除A位, 给它第二次机会(映射者正在其他CPU上运行时同样跳过)
+        if (rmap_referenced(pa)) {
+            pg->age = 0;
+            continue;
+        }
+
+        int slot = slot_alloc();
+        if (slot < 0)
+            break;
+        // 交换缓存自己持有一个页面引用, 每个映射的引用由rmap_unmap_all释放
+        if (!pmem_tryget(pa)) {
+            slot_put(slot);
+            continue;
+        }
+        uint32 n = rmap_unmap_all(pa, SWAP_TO_PTE(slot, 0));
+        if (n == 0) {
+            pmem_free(pa, false);
+            slot_put(slot);
+            continue;
+        }
+        slot_ref[slot] += n;
+        cache[ncache].slot = slot;
+        cache[ncache].pa = pa;
+        ncache++;
+    }
+}
+
+// 挑选最多npages个冷页面并换出
+// 返回归还给user_region的页面数
+uint32 swap_reclaim(uint32 npages)
+{
+    // 写回磁盘需要睡眠: 没有交换区、没有进程上下文或持有自旋锁时不能回收
+    if (nslots == 0 || myproc() == NULL || mycpu()->noff > 0)
+        return 0;
+    if (npages > SWAP_BATCH)
+        npages = SWAP_BATCH;
+
+    spinlock_acquire(&swap_lk);
+    // 交换缓存同一时间只服务一批页面
+    while (reclaiming)
+        proc_sleep(&reclaiming, &swap_lk);
+    reclaiming = true;
+
+    // 先换出工作集估计认为最冷的页面, 不够时逐步放宽, 最后退回普通的时钟算法
+    uint32 total = (user_region.end - user_region.begin) / PGSIZE;
+    pick_victims(npages, WSS_COLD_AGE, total);
+    pick_victims(npages, 1, total);
+    pick_victims(npages, 0, 2 * total);
+
+    // 批量刷新TLB: 清除的A位和改写的交换项从此生效
+    sfence_vma();
+    uint32 n = ncache;
+    spinlock_release(&swap_lk);
+
+    // 逐页压缩进压缩池, 放不进去的才写回磁盘(会睡眠)
+    // cache[]在reclaiming期间只会被标记, 不会被改写
+    for (uint32 i = 0; i < n; i++) {
+        if (!zswap_store(cache[i].slot, cache[i].pa))
+            virtio_disk_rw_page(swap_start + cache[i].slot * SWAP_BLOCKS_PER_PAGE, cache[i].pa, true);
+    }
+
+    // 写回期间被缺页取回的页面仍有映射者, 这里只减少引用计数
+    uint32 freed = 0;
+    spinlock_acquire(&swap_lk);
+    for (uint32 i = 0; i < n; i++) {
+        if (pmem_page(cache[i].pa)->ref == 1)
+            freed++;
+        pmem_free(cache[i].pa, false);
+        slot_put(cache[i].slot);
+    }
+    ncache = 0;
+    reclaiming = false;
+    proc_wakeup(&reclaiming);
+    spinlock_release(&swap_lk);
+
+    return freed;
+}
+
+// 把va所在的被换出页面读回并重新映射
+// va对应的PTE不是交换项时返回false
+bool swap_in(pgtbl_t pgtbl, uint64 va)
+{
+    va = PG_ROUND_DOWN(va);
+    pte_t* pte = vm_getpte(pgtbl, va, false);
+    if (pte == NULL || !PTE_IS_SWAP(*pte))
+        return false;
+
+    pte_t old = *pte;
+    uint32 slot = PTE_TO_SWAP(old);
+    // 换入的页面马上会被访问, 预先置A位避免它立刻再被换出
+    int perm = (PTE_FLAGS(old) & (PTE_R | PTE_W | PTE_X | PTE_U | PTE_COW)) | PTE_A;
+
+    spinlock_acquire(&swap_lk);
+    swap_cache_t* c = cache_lookup(slot);
+    if (c != NULL) {
+        // 页面还在写回途中, 直接取回(共享页面仍然共享, 写时复制标记不变)
+        uint64 pa = c->pa;
+        pmem_get(pa);
+        slot_put(slot);
+        spinlock_release(&swap_lk);
+        vm_mappages(pgtbl, va, pa, PGSIZE, perm);
+        return true;
+    }
+    spinlock_release(&swap_lk);
+
+    uint64 pa = uvm_page_alloc();
+    if (pa == 0)
+        return false;
+    if (!zswap_load(slot, pa))
+        virtio_disk_rw_page(swap_start + slot * SWAP_BLOCKS_PER_PAGE, pa, false);
+
+    // 睡眠期间交换项可能已被换入或丢弃
+    pte = vm_getpte(pgtbl, va, false);
+    if (pte == NULL || *pte != old) {
+        pmem_free(pa, false);
+        return pte != NULL && (*pte & PTE_V);
+    }
+
+    spinlock_acquire(&swap_lk);
+    slot_put(slot);
+    spinlock_release(&swap_lk);
+    // 读回的是私有副本, 共享页面的写时复制标记不需要保留
+    if (perm & PTE_COW)
+        perm = (perm | PTE_W) & ~PTE_COW;
+    vm_mappages(pgtbl, va, pa, PGSIZE, perm);
+    return true;
+}
+
+// 交换项被丢弃(解除映射或进程退出)时释放它占用的槽
+void swap_free(pte_t pte)
+{
+    spinlock_acquire(&swap_lk);
+    slot_put(PTE_TO_SWAP(pte));
+    spinlock_release(&swap_lk);
+}
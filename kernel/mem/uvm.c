@@ -1,10 +1,13 @@
 //#include "mem/mmap.h"
 #include "mem/pmem.h"
 #include "mem/vmem.h"
+#include "mem/swap.h"
+#include "mem/compact.h"
 #include "proc/cpu.h"
 #include "lib/print.h"
 //#include "lib/str.h"
 #include "memlayout.h"
+#include "riscv.h"
 
 // 连续虚拟空间的复制(在uvm_copy_pgtbl中使用)
 /* static void copy_range(pgtbl_t old, pgtbl_t new, uint64 begin, uint64 end)
@@ -64,23 +67,36 @@
 
 // 递归释放 页表占用的物理页 和 页表管理的物理页
 // ps: 顶级页表level = 3, level = 0 说明是页表管理的物理页
-static void destroy_pgtbl(pgtbl_t pgtbl, uint32 level)
+// root是顶级页表, va是pgtbl覆盖的起始虚拟地址(用于撤销反向映射)
+static void destroy_pgtbl(pgtbl_t root, pgtbl_t pgtbl, uint32 level, uint64 va)
 {
     // 遍历当前页表的所有项
     for(int i = 0; i < 512; i++) {
         pte_t pte = pgtbl[i];
+        uint64 child_va = va + ((uint64)i << VA_SHIFT(level - 1));
         if((pte & PTE_V) && (pte & (PTE_R | PTE_W | PTE_X)) == 0) {
             // 这是一个指向下级页表的有效页表项
             uint64 child_pa = PTE_TO_PA(pte);
-            destroy_pgtbl((pgtbl_t)child_pa, level - 1);
+            destroy_pgtbl(root, (pgtbl_t)child_pa, level - 1, child_va);
         } else if(pte & PTE_V) {
-            // 这是一个指向物理页的有效页表项 (level == 0时)
+            // 这是一个指向物理页的有效页表项
+            // level == 2 时它是一个2MiB大页
             uint64 pa = PTE_TO_PA(pte);
-            pmem_free(pa, false); // 释放用户物理页
+            if(level == 2) {
+                for(int j = 0; j < 512; j++)
+                    rmap_remove(pa + j * PGSIZE, root, child_va + j * PGSIZE);
+                pmem_free_huge(pa);
+            } else {
+                rmap_remove(pa, root, child_va);
+                pmem_free(pa, false); // 释放用户物理页
+            }
+        } else if(PTE_IS_SWAP(pte)) {
+            // 已被换出的页面只需释放交换槽
+            swap_free(pte);
         }
     }
-    // 释放当前页表所占用的物理页
-    pmem_free((uint64)pgtbl, false);
+    // 释放当前页表所占用的物理页(页表页来自kern_region)
+    pmem_free((uint64)pgtbl, true);
 }
 
 // 页表销毁：trapframe 和 trampoline 单独处理
@@ -106,7 +122,52 @@ void uvm_destroy_pgtbl(pgtbl_t pgtbl, uint32 level)
     }
 
     // 调用内部的递归释放函数
-    destroy_pgtbl(pgtbl, level);
+    destroy_pgtbl(pgtbl, pgtbl, level, 0);
+}
+
+// 申请一个大页, 没有空闲的对齐块时先尝试内存规整
+static uint64 huge_alloc()
+{
+    uint64 pa = (uint64)pmem_alloc_huge();
+    if(pa == 0 && compact_try_huge())
+        pa = (uint64)pmem_alloc_huge();
+    return pa;
+}
+
+// 为new申请一个物理页, 拷贝src_pa处的一页内容, 并映射到va
+static void copy_page(pgtbl_t new, uint64 va, uint64 src_pa, int flags)
+{
+    uint64 new_pa = uvm_page_alloc();
+    if(new_pa == 0) {
+        panic("uvm_copy_pgtbl: pmem_alloc failed");
+    }
+    memmove((void*)new_pa, (void*)src_pa, PGSIZE);
+    vm_mappages(new, va, new_pa, PGSIZE, flags);
+}
+
+// 拷贝old中va处的4KiB页面(有效页面或交换项)到new
+static void copy_user_page(pgtbl_t old, pgtbl_t new, uint64 va)
+{
+    pte_t* pte = vm_getpte(old, va, false);
+    if(pte == NULL || (!(*pte & PTE_V) && !PTE_IS_SWAP(*pte)))
+        return;
+
+    // 先为子进程申请页面: 申请时可能触发回收, 不能让它换出下面要读取的父进程页面
+    uint64 new_pa = uvm_page_alloc();
+    if(new_pa == 0) {
+        panic("uvm_copy_pgtbl: pmem_alloc failed");
+    }
+    // 父进程的页面已被换出, 先换入再拷贝
+    if(PTE_IS_SWAP(*pte) && !uvm_fault(old, va, false)) {
+        panic("uvm_copy_pgtbl: swap in failed");
+    }
+    pte = vm_getpte(old, va, false);
+    memmove((void*)new_pa, (void*)PTE_TO_PA(*pte), PGSIZE);
+    // 子进程得到的是私有副本, 共享页面的写时复制标记不需要继承
+    int flags = PTE_FLAGS(*pte);
+    if(flags & PTE_COW)
+        flags = (flags | PTE_W) & ~PTE_COW;
+    vm_mappages(new, va, new_pa, PGSIZE, flags);
 }
 
 // 拷贝页表 (拷贝并不包括trapframe 和 trampoline)
@@ -116,27 +177,25 @@ void uvm_copy_pgtbl(pgtbl_t old, pgtbl_t new, uint64 heap_top, uint32 ustack_pag
     // 用户空间通常从0开始到heap_top
     uint64 USER_BASE = 0;
     for(uint64 va = USER_BASE; va < heap_top; va += PGSIZE) {
-        pte_t* pte = vm_getpte(old, va, false);
-        if(pte != NULL && (*pte & PTE_V)) {
-            uint64 pa = PTE_TO_PA(*pte);
-            int flags = PTE_FLAGS(*pte);
-
-            // 分配新的物理页并拷贝内容
-            uint64 new_pa = (uint64)pmem_alloc(false);
-            if(new_pa == 0) {
-                panic("uvm_copy_pgtbl: pmem_alloc failed");
-            }
-
-            // 拷贝页面内容
-            char* src = (char*)pa;
-            char* dst = (char*)new_pa;
-            for(int i = 0; i < PGSIZE; i++) {
-                dst[i] = src[i];
+        pte_t* huge = vm_gethuge(old, va);
+        if(huge != NULL) {
+            uint64 pa = PTE_TO_PA(*huge);
+            int flags = PTE_FLAGS(*huge);
+            // 子进程优先也使用大页, 没有连续物理块时整个大页退回4KiB页面
+            // 每个大页只尝试一次, 避免逐页重复触发内存规整
+            uint64 base = HUGE_ROUND_DOWN(va);
+            uint64 new_pa = huge_alloc();
+            if(new_pa != 0) {
+                memmove((void*)new_pa, (void*)pa, HUGE_PGSIZE);
+                vm_mappages(new, base, new_pa, HUGE_PGSIZE, flags);
+            } else {
+                for(uint64 off = 0; off < HUGE_PGSIZE; off += PGSIZE)
+                    copy_page(new, base + off, pa + off, flags);
             }
-
-            // 在新页表中建立映射
-            vm_mappages(new, va, new_pa, PGSIZE, flags);
+            va = base + HUGE_PGSIZE - PGSIZE;
+            continue;
         }
+        copy_user_page(old, new, va);
     }
 
     /* step-2: ustack */
@@ -148,31 +207,28 @@ void uvm_copy_pgtbl(pgtbl_t old, pgtbl_t new, uint64 heap_top, uint32 ustack_pag
     uint64 USTACK_BASE = TRAPFRAME - PGSIZE;
     for(uint32 i = 0; i < ustack_pages; i++) {
         uint64 va = USTACK_BASE - i * PGSIZE;
-        pte_t* pte = vm_getpte(old, va, false);
-        if(pte != NULL && (*pte & PTE_V)) {
-            uint64 pa = PTE_TO_PA(*pte);
-            int flags = PTE_FLAGS(*pte);
-
-            // 分配新的物理页并拷贝内容
-            uint64 new_pa = (uint64)pmem_alloc(false);
-            if(new_pa == 0) {
-                panic("uvm_copy_pgtbl: pmem_alloc failed");
-            }
-
-            // 拷贝页面内容
-            char* src = (char*)pa;
-            char* dst = (char*)new_pa;
-            for(int i = 0; i < PGSIZE; i++) {
-                dst[i] = src[i];
-            }
-
-            // 在新页表中建立映射
-            vm_mappages(new, va, new_pa, PGSIZE, flags);
-        }
+        copy_user_page(old, new, va);
     }
 
     /* step-3: mmap_region */
     // mmap相关的不实现，跳过
+
+    /* step-4: mremap区域 */
+    // 区域很大但通常很稀疏, 按页表层级跳过没有映射的部分
+    for(uint64 va = MMAP_BASE; va < MMAP_END; ) {
+        pte_t top = old[VA_TO_VPN(va, 2)];
+        if(!(top & PTE_V)) {
+            va = (va | ((1ul << VA_SHIFT(2)) - 1)) + 1;
+            continue;
+        }
+        pte_t mid = ((pgtbl_t)PTE_TO_PA(top))[VA_TO_VPN(va, 1)];
+        if(!(mid & PTE_V)) {
+            va = HUGE_ROUND_DOWN(va) + HUGE_PGSIZE;
+            continue;
+        }
+        copy_user_page(old, new, va);
+        va += PGSIZE;
+    }
 }
 
 // 在用户页表和进程mmap链里 新增mmap区域 [begin, begin + npages * PGSIZE)
@@ -204,6 +260,7 @@ void uvm_munmap(uint64 begin, uint32 npages)
 
 // 用户堆空间增加, 返回新的堆顶地址 (注意栈顶最大值限制)
 // 在这里无需修正 p->heap_top
+// 完整覆盖的2MiB对齐区间优先使用大页, 没有连续物理块时退回4KiB页面
 uint64 uvm_heap_grow(pgtbl_t pgtbl, uint64 heap_top, uint32 len)
 {
     uint64 new_heap_top = heap_top + len;
@@ -214,18 +271,22 @@ uint64 uvm_heap_grow(pgtbl_t pgtbl, uint64 heap_top, uint32 len)
     uint64 new_heap_aligned = (new_heap_top + PGSIZE - 1) & ~(PGSIZE - 1);
 
     for(uint64 va = old_heap_aligned; va < new_heap_aligned; va += PGSIZE) {
+        if(va % HUGE_PGSIZE == 0 && new_heap_aligned - va >= HUGE_PGSIZE) {
+            uint64 pa = huge_alloc();
+            if(pa != 0) {
+                memset((void*)pa, 0, HUGE_PGSIZE);
+                vm_mappages(pgtbl, va, pa, HUGE_PGSIZE, PTE_R | PTE_W | PTE_U);
+                va += HUGE_PGSIZE - PGSIZE;
+                continue;
+            }
+        }
+
         // 分配物理页
-        uint64 pa = (uint64)pmem_alloc(false);
+        uint64 pa = uvm_page_alloc();
         if(pa == 0) {
-            // 分配失败，需要回滚已分配的页面
-            for(uint64 rollback_va = old_heap_aligned; rollback_va < va; rollback_va += PGSIZE) {
-                pte_t* pte = vm_getpte(pgtbl, rollback_va, false);
-                if(pte != NULL && (*pte & PTE_V)) {
-                    uint64 rollback_pa = PTE_TO_PA(*pte);
-                    pmem_free(rollback_pa, false);
-                    *pte = 0;
-                }
-            }
+            // 分配失败，需要回滚已分配的页面(其中一些可能已被换出)
+            if(va > old_heap_aligned)
+                uvm_heap_ungrow(pgtbl, va, va - old_heap_aligned);
             return heap_top; // 返回原来的heap_top
         }
 
@@ -239,6 +300,33 @@ uint64 uvm_heap_grow(pgtbl_t pgtbl, uint64 heap_top, uint32 len)
     return new_heap_top;
 }
 
+// 解除[begin, end)内所有页面的映射并释放(包括被换出的页面), begin和end按页对齐
+// 大页只被部分释放时会被拆分, 剩余部分继续以4KiB页面映射
+static void free_range(pgtbl_t pgtbl, uint64 begin, uint64 end)
+{
+    for(uint64 va = begin; va < end; va += PGSIZE) {
+        if(vm_gethuge(pgtbl, va) != NULL) {
+            if(va % HUGE_PGSIZE == 0 && end - va >= HUGE_PGSIZE) {
+                vm_unmappages(pgtbl, va, HUGE_PGSIZE, true);
+                va += HUGE_PGSIZE - PGSIZE;
+                continue;
+            }
+            vm_split_huge(pgtbl, va);
+        }
+        pte_t* pte = vm_getpte(pgtbl, va, false);
+        if(pte != NULL && (*pte & PTE_V)) {
+            uint64 pa = PTE_TO_PA(*pte);
+            rmap_remove(pa, pgtbl, va);
+            pmem_free(pa, false); // 释放物理页
+            *pte = 0; // 清除页表项
+        } else if(pte != NULL && PTE_IS_SWAP(*pte)) {
+            swap_free(*pte);
+            *pte = 0;
+        }
+    }
+    sfence_vma();
+}
+
 // 用户堆空间减少, 返回新的堆顶地址
 // 在这里无需修正 p->heap_top
 uint64 uvm_heap_ungrow(pgtbl_t pgtbl, uint64 heap_top, uint32 len)
@@ -255,16 +343,218 @@ uint64 uvm_heap_ungrow(pgtbl_t pgtbl, uint64 heap_top, uint32 len)
     uint64 new_heap_aligned = (new_heap_top + PGSIZE - 1) & ~(PGSIZE - 1); // 向上对齐到页边界
     uint64 old_heap_aligned = (heap_top + PGSIZE - 1) & ~(PGSIZE - 1);
 
-    for(uint64 va = new_heap_aligned; va < old_heap_aligned; va += PGSIZE) {
-        pte_t* pte = vm_getpte(pgtbl, va, false);
-        if(pte != NULL && (*pte & PTE_V)) {
-            uint64 pa = PTE_TO_PA(*pte);
-            pmem_free(pa, false); // 释放物理页
-            *pte = 0; // 清除页表项
+    free_range(pgtbl, new_heap_aligned, old_heap_aligned);
+
+    return new_heap_top;
+}
+
+// [va, va + len)中没有任何映射(包括交换项)
+static bool range_unmapped(pgtbl_t pgtbl, uint64 va, uint64 len)
+{
+    for(uint64 a = va; a < va + len; a += PGSIZE) {
+        if(vm_gethuge(pgtbl, a) != NULL)
+            return false;
+        pte_t* pte = vm_getpte(pgtbl, a, false);
+        if(pte != NULL && *pte != 0)
+            return false;
+    }
+    return true;
+}
+
+// 在mremap区域中找一段长度为len的空闲虚拟地址, 找不到返回0
+static uint64 mmap_find_free(pgtbl_t pgtbl, uint64 len)
+{
+    uint64 va = MMAP_BASE;
+    while(va + len <= MMAP_END) {
+        uint64 a;
+        for(a = va; a < va + len; a += PGSIZE) {
+            pte_t* pte = vm_getpte(pgtbl, a, false);
+            if(vm_gethuge(pgtbl, a) != NULL || (pte != NULL && *pte != 0))
+                break;
+        }
+        if(a == va + len)
+            return va;
+        va = a + PGSIZE;
+    }
+    return 0;
+}
+
+// 把[old, old + len)的PTE原样搬到[new, new + len), 不拷贝页面内容
+// 被换出的页面只需搬动交换项, 大页先拆分成4KiB页面
+static void move_ptes(pgtbl_t pgtbl, uint64 old, uint64 new, uint64 len)
+{
+    for(uint64 off = 0; off < len; off += PGSIZE) {
+        vm_split_huge(pgtbl, old + off);
+        pte_t* src = vm_getpte(pgtbl, old + off, false);
+        pte_t val = *src;
+        *src = 0;
+        pte_t* dst = vm_getpte(pgtbl, new + off, true);
+        if(dst == NULL)
+            panic("uvm_mremap: no page for pgtbl");
+        *dst = val;
+        if((val & PTE_V) && (val & PTE_U)) {
+            rmap_remove(PTE_TO_PA(val), pgtbl, old + off);
+            rmap_add(PTE_TO_PA(val), pgtbl, new + off);
         }
     }
+    sfence_vma();
+}
 
-    return new_heap_top;
+// 为[va, va + len)申请清零的页面, 失败时回滚并返回false
+static bool map_zero(pgtbl_t pgtbl, uint64 va, uint64 len, int perm)
+{
+    for(uint64 off = 0; off < len; off += PGSIZE) {
+        uint64 pa = uvm_page_alloc();
+        if(pa == 0) {
+            free_range(pgtbl, va, va + off);
+            return false;
+        }
+        memset((void*)pa, 0, PGSIZE);
+        vm_mappages(pgtbl, va + off, pa, PGSIZE, perm);
+    }
+    return true;
+}
+
+// 调整已有映射[old, old + old_len)的大小为new_len(都按页对齐, 范围已由调用者检查)
+// 缩小时释放尾部; 扩大时优先原地扩展, 否则在maymove为真时把PTE整体搬到mremap区域
+// 扩展出的部分是清零的新页面, 原有页面内容不拷贝
+// 成功返回映射的新地址, 失败返回0
+uint64 uvm_mremap(pgtbl_t pgtbl, uint64 old, uint64 old_len, uint64 new_len, bool maymove)
+{
+    for(uint64 a = old; a < old + old_len; a += PGSIZE) {
+        if(vm_gethuge(pgtbl, a) != NULL)
+            continue;
+        pte_t* pte = vm_getpte(pgtbl, a, false);
+        if(pte == NULL || !((*pte & PTE_V) || PTE_IS_SWAP(*pte)) || !(*pte & PTE_U))
+            return 0;
+    }
+
+    if(new_len <= old_len) {
+        free_range(pgtbl, old + new_len, old + old_len);
+        return old;
+    }
+
+    // 扩展部分沿用映射末尾页面的权限
+    pte_t* last = vm_getpte(pgtbl, old + old_len - PGSIZE, false);
+    int perm = PTE_FLAGS(*last) & (PTE_R | PTE_W | PTE_X | PTE_U);
+    if(*last & PTE_COW)
+        perm |= PTE_W;
+
+    // 原地扩展只在mremap区域内进行, 避免占用堆将要增长的地址
+    uint64 grow = new_len - old_len;
+    if(old >= MMAP_BASE && old + new_len <= MMAP_END
+       && range_unmapped(pgtbl, old + old_len, grow)) {
+        return map_zero(pgtbl, old + old_len, grow, perm) ? old : 0;
+    }
+    if(!maymove)
+        return 0;
+
+    uint64 new = mmap_find_free(pgtbl, new_len);
+    if(new == 0)
+        return 0;
+    if(!map_zero(pgtbl, new + old_len, grow, perm))
+        return 0;
+    move_ptes(pgtbl, old, new, old_len);
+    return new;
+}
+
+// 申请一个用户物理页
+// 内存耗尽时先换出一批冷页面再重试, 仍然失败返回0
+uint64 uvm_page_alloc()
+{
+    uint64 pa = (uint64)pmem_alloc(false);
+    if(pa == 0 && swap_reclaim(SWAP_BATCH) > 0)
+        pa = (uint64)pmem_alloc(false);
+    return pa;
+}
+
+// 写时复制: 页面仍被共享时为进程复制一份私有页面, 否则直接恢复写权限
+static bool cow_break(pgtbl_t pgtbl, uint64 va)
+{
+    pte_t* pte = vm_getpte(pgtbl, va, false);
+    uint64 pa = PTE_TO_PA(*pte);
+    int flags = (PTE_FLAGS(*pte) | PTE_W) & ~PTE_COW;
+
+    if(!pmem_unshare(pa)) {
+        uint64 new_pa = uvm_page_alloc();
+        if(new_pa == 0)
+            return false;
+        // 申请页面时可能睡眠或触发回收, 重新检查PTE
+        // 共享页面在此期间被换出时返回true, 由uvm_fault换入后重试
+        pte = vm_getpte(pgtbl, va, false);
+        if(pte == NULL || !(*pte & PTE_V) || !(*pte & PTE_COW)) {
+            pmem_free(new_pa, false);
+            return pte != NULL && ((*pte & PTE_V) || PTE_IS_SWAP(*pte));
+        }
+        pa = PTE_TO_PA(*pte);
+        memmove((void*)new_pa, (void*)pa, PGSIZE);
+        vm_mappages(pgtbl, va, new_pa, PGSIZE, flags);
+        pmem_free(pa, false); // 共享页面的引用计数减一
+    } else {
+        // 其他映射者都已离开, 页面重新归本进程私有
+        vm_mappages(pgtbl, va, pa, PGSIZE, flags);
+    }
+    sfence_vma();
+    return true;
+}
+
+// 用户页面缺页处理, 能够修复时返回true
+// 被换出的页面先换入; write为真且遇到写时复制页面时解除共享
+// 修复当前进程的页表时持有mm->lk, 避免与同一地址空间的其他线程同时修复同一个页面
+// (fork复制页表时调用者已经持有)
+bool uvm_fault(pgtbl_t pgtbl, uint64 va, bool write)
+{
+    if(va >= MAXVA)
+        return false;
+    va = PG_ROUND_DOWN(va);
+
+    proc_t* p = myproc();
+    mm_t* mm = (p != NULL && p->mm != NULL && p->mm->pgtbl == pgtbl) ? p->mm : NULL;
+    bool locked = mm != NULL && !mm_holding(mm);
+    if(locked)
+        mm_lock(mm);
+
+    // 解除共享时申请页面可能触发回收, 把这个共享页面又换出去, 这时重新换入
+    bool fixed;
+    pte_t* pte;
+    do {
+        fixed = swap_in(pgtbl, va);
+        pte = vm_getpte(pgtbl, va, false);
+        if(write && pte != NULL && (*pte & PTE_V) && (*pte & PTE_COW)) {
+            fixed = cow_break(pgtbl, va);
+            pte = vm_getpte(pgtbl, va, false);
+        }
+    } while(fixed && pte != NULL && PTE_IS_SWAP(*pte));
+
+    if(locked)
+        mm_unlock(mm);
+    return fixed;
+}
+
+// 用户虚拟地址翻译, 页面已被换出时先换入, 写入写时复制页面前先解除共享
+static uint64 user_walkaddr(pgtbl_t pgtbl, uint64 va, bool write)
+{
+    uint64 pa = vm_walkaddr(pgtbl, va);
+    if((pa == 0 || write) && uvm_fault(pgtbl, va, write))
+        pa = vm_walkaddr(pgtbl, va);
+    return pa;
+}
+
+// 统计用户页表中2MiB大页的数量
+uint32 uvm_huge_count(pgtbl_t pgtbl)
+{
+    uint32 count = 0;
+    for(int i = 0; i < 512; i++) {
+        pte_t pte = pgtbl[i];
+        if(!(pte & PTE_V) || !PTE_CHECK(pte))
+            continue;
+        pgtbl_t mid = (pgtbl_t)PTE_TO_PA(pte);
+        for(int j = 0; j < 512; j++) {
+            if((mid[j] & PTE_V) && !PTE_CHECK(mid[j]))
+                count++;
+        }
+    }
+    return count;
 }
 
 // 用户态地址空间[src, src+len) 拷贝至 内核态地址空间[dst, dst+len)
@@ -278,17 +568,13 @@ void uvm_copyin(pgtbl_t pgtbl, uint64 dst, uint64 src, uint32 len)
     uint32 copied = 0;
 
     while(copied < len) {
-        // 获取当前用户虚拟地址对应的页表项
-        pte_t* pte = vm_getpte(pgtbl, src_va, false);
-        if(pte == NULL || !(*pte & PTE_V)) {
+        // 获取当前用户虚拟地址对应的物理地址(可能位于大页内)
+        uint64 src_pa = user_walkaddr(pgtbl, src_va, false);
+        if(src_pa == 0) {
             panic("uvm_copyin: invalid virtual address");
             return;
         }
-
-        // 计算物理地址和页内偏移
-        uint64 pa = PTE_TO_PA(*pte);
         uint64 page_offset = src_va & (PGSIZE - 1);
-        uint64 src_pa = pa + page_offset;
 
         // 计算本次拷贝的字节数（不能超过页边界）
         uint32 bytes_in_page = PGSIZE - page_offset;
@@ -318,17 +604,13 @@ void uvm_copyout(pgtbl_t pgtbl, uint64 dst, uint64 src, uint32 len)
     uint32 copied = 0;
 
     while(copied < len) {
-        // 获取当前用户虚拟地址对应的页表项
-        pte_t* pte = vm_getpte(pgtbl, dst_va, false);
-        if(pte == NULL || !(*pte & PTE_V)) {
+        // 获取当前用户虚拟地址对应的物理地址(可能位于大页内)
+        uint64 dst_pa = user_walkaddr(pgtbl, dst_va, true);
+        if(dst_pa == 0) {
             panic("uvm_copyout: invalid virtual address");
             return;
         }
-
-        // 计算物理地址和页内偏移
-        uint64 pa = PTE_TO_PA(*pte);
         uint64 page_offset = dst_va & (PGSIZE - 1);
-        uint64 dst_pa = pa + page_offset;
 
         // 计算本次拷贝的字节数（不能超过页边界）
         uint32 bytes_in_page = PGSIZE - page_offset;
@@ -360,17 +642,13 @@ void uvm_copyin_str(pgtbl_t pgtbl, uint64 dst, uint64 src, uint32 maxlen)
     uint32 copied = 0;
 
     while(copied < maxlen) {
-        // 获取当前用户虚拟地址对应的页表项
-        pte_t* pte = vm_getpte(pgtbl, src_va, false);
-        if(pte == NULL || !(*pte & PTE_V)) {
+        // 获取当前用户虚拟地址对应的物理地址(可能位于大页内)
+        uint64 src_pa = user_walkaddr(pgtbl, src_va, false);
+        if(src_pa == 0) {
             panic("uvm_copyin_str: invalid virtual address");
             return;
         }
-
-        // 计算物理地址和页内偏移
-        uint64 pa = PTE_TO_PA(*pte);
         uint64 page_offset = src_va & (PGSIZE - 1);
-        uint64 src_pa = pa + page_offset;
 
         // 计算本次拷贝的字节数（不能超过页边界和maxlen）
         uint32 bytes_in_page = PGSIZE - page_offset;
@@ -2,23 +2,36 @@
 #include "mem/pmem.h"
 #include "common.h"
 #include "memlayout.h"
+#include "riscv.h"
 #define VA_MAX (1ul << 38)   
-pte_t* vm_getpte(pgtbl_t pgtbl, uint64 va, bool alloc)
+// 把pte指向的2MiB大页拆分成一张装满512个4KiB叶子PTE的低级页表
+// 拆分前后映射的物理地址和权限完全一致
+static void split_huge(pte_t* pte)
 {
-    // 如果pgtbl为NULL，使用内核页表
-    if (pgtbl == NULL) {
-        extern pgtbl_t kernel_pgtbl;
-        pgtbl = kernel_pgtbl;
-    }
-
-    // 检查虚拟地址是否合法
-    if (va >= VA_MAX)
-        panic("vm_getpte: va out of range");
+    pgtbl_t newtbl = (pgtbl_t)pmem_alloc(true);
+    if (newtbl == NULL)
+        panic("split_huge: no page for pgtbl");
+    uint64 pa = PTE_TO_PA(*pte);
+    int flags = PTE_FLAGS(*pte);
+    for (int i = 0; i < 512; i++)
+        newtbl[i] = PA_TO_PTE(pa + i * PGSIZE) | flags;
+    *pte = PA_TO_PTE(newtbl) | PTE_V;
+    sfence_vma();
+}
 
-    // 三级页表遍历
-    for (int level = 2; level > 0; level--) {
-        int idx = VA_TO_VPN(va, level); // 获取当前级别的VPN
-        pte_t* pte = &pgtbl[idx];
+// 页表遍历: 返回va在第level级页表中对应的PTE
+// 途中遇到大页叶子时: alloc为真则先拆分再继续, 否则直接返回这个叶子
+static pte_t* walk(pgtbl_t pgtbl, uint64 va, int level, bool alloc)
+{
+    for (int lv = 2; lv > level; lv--) {
+        pte_t* pte = &pgtbl[VA_TO_VPN(va, lv)];
+        if ((*pte & PTE_V) && !PTE_CHECK(*pte)) {
+            // 叶子PTE出现在高级页表中, 说明这是一个大页
+            if (!alloc)
+                return pte;
+            assert(lv == 1, "walk: giga page");
+            split_huge(pte);
+        }
         if (*pte & PTE_V) {
             // 有效，跳转到下一级页表
             pgtbl = (pgtbl_t)PTE_TO_PA(*pte);
@@ -27,43 +40,183 @@ pte_t* vm_getpte(pgtbl_t pgtbl, uint64 va, bool alloc)
             if (!alloc)
                 return NULL;
             pgtbl_t newtbl = (pgtbl_t)pmem_alloc(true);
+            if (newtbl == NULL)
+                return NULL;
             memset(newtbl, 0, PGSIZE);
             *pte = PA_TO_PTE(newtbl) | PTE_V;
             pgtbl = newtbl;
         }
     }
-    // 最低级页表项
-    int idx = VA_TO_VPN(va, 0);
-    return &pgtbl[idx];
+    return &pgtbl[VA_TO_VPN(va, level)];
 }
+
+// 返回va对应的最低级PTE
+// alloc为真时保证返回4KiB粒度的PTE(必要时拆分大页)
+// alloc为假且va落在大页内时, 返回的是level-1的大页叶子PTE
+pte_t* vm_getpte(pgtbl_t pgtbl, uint64 va, bool alloc)
+{
+    // 如果pgtbl为NULL，使用内核页表
+    if (pgtbl == NULL) {
+        extern pgtbl_t kernel_pgtbl;
+        pgtbl = kernel_pgtbl;
+    }
+
+    // 检查虚拟地址是否合法
+    if (va >= VA_MAX)
+        panic("vm_getpte: va out of range");
+
+    // 三级页表遍历
+    return walk(pgtbl, va, 0, alloc);
+}
+
+// 如果va落在一个大页内, 返回这个大页的叶子PTE, 否则返回NULL
+pte_t* vm_gethuge(pgtbl_t pgtbl, uint64 va)
+{
+    if (pgtbl == NULL) {
+        extern pgtbl_t kernel_pgtbl;
+        pgtbl = kernel_pgtbl;
+    }
+    if (va >= VA_MAX)
+        panic("vm_gethuge: va out of range");
+
+    pte_t* pte = walk(pgtbl, va, 1, false);
+    if (pte != NULL && (*pte & PTE_V) && !PTE_CHECK(*pte))
+        return pte;
+    return NULL;
+}
+
+// 虚拟地址va翻译成物理地址(包含页内偏移), 未映射返回0
+uint64 vm_walkaddr(pgtbl_t pgtbl, uint64 va)
+{
+    pte_t* pte = vm_gethuge(pgtbl, va);
+    if (pte != NULL)
+        return PTE_TO_PA(*pte) + (va & (HUGE_PGSIZE - 1));
+
+    pte = vm_getpte(pgtbl, va, false);
+    if (pte == NULL || !(*pte & PTE_V))
+        return 0;
+    return PTE_TO_PA(*pte) + (va & (PGSIZE - 1));
+}
+
+// 如果va落在一个大页内, 把它拆分成4KiB页面
+void vm_split_huge(pgtbl_t pgtbl, uint64 va)
+{
+    pte_t* pte = vm_gethuge(pgtbl, va);
+    if (pte != NULL)
+        split_huge(pte);
+}
+
+// 维护用户页面的反向映射: 撤销被覆盖的旧映射, 记录新映射
+static void rmap_update(pgtbl_t pgtbl, uint64 va, pte_t old, uint64 pa, int perm)
+{
+    if ((old & PTE_V) && (old & PTE_U))
+        rmap_remove(PTE_TO_PA(old), pgtbl, va);
+    if (perm & PTE_U)
+        rmap_add(pa, pgtbl, va);
+}
+
 // 将虚拟地址va开始的len字节映射到物理地址pa，权限为perm
+// va和pa都按2MiB对齐且剩余长度足够时, 使用大页叶子PTE
 void vm_mappages(pgtbl_t pgtbl, uint64 va, uint64 pa, uint64 len, int perm)
 {
     uint64 start = va;
     uint64 end = va + len;
-    for (; start < end; start += PGSIZE, pa += PGSIZE) {
+    while (start < end) {
+        if (start % HUGE_PGSIZE == 0 && pa % HUGE_PGSIZE == 0 && end - start >= HUGE_PGSIZE) {
+            pte_t* pte = walk(pgtbl, start, 1, true);
+            if (!pte)
+                panic("vm_mappages: walk fail");
+            // 原有的低级页表被大页取代, 它必须已经空了(包括交换项), 否则其中的映射会泄漏
+            if ((*pte & PTE_V) && PTE_CHECK(*pte)) {
+                pgtbl_t old = (pgtbl_t)PTE_TO_PA(*pte);
+                for (int i = 0; i < 512; i++)
+                    assert(old[i] == 0, "vm_mappages: remap");
+                pmem_free((uint64)old, true);
+            } else {
+                assert(!(*pte & PTE_V), "vm_mappages: remap");
+            }
+            *pte = PA_TO_PTE(pa) | perm | PTE_V;
+            for (int i = 0; i < 512; i++)
+                rmap_update(pgtbl, start + i * PGSIZE, 0, pa + i * PGSIZE, perm);
+            start += HUGE_PGSIZE;
+            pa += HUGE_PGSIZE;
+            continue;
+        }
         pte_t* pte = vm_getpte(pgtbl, start, true);
         if (!pte)
             panic("vm_mappages: getpte fail");
         //if (*pte & PTE_V)
         //    panic("vm_mappages: remap"); // 不允许重复映射
+        pte_t old = *pte;
         *pte = PA_TO_PTE(pa) | perm | PTE_V;
+        rmap_update(pgtbl, start, old, pa, perm);
+        start += PGSIZE;
+        pa += PGSIZE;
     }
 }
+
+// 解除[va, va + len)的映射, freeit为真时释放物理页
+// 完整覆盖的大页整体释放, 部分覆盖的大页先拆分
 void vm_unmappages(pgtbl_t pgtbl, uint64 va, uint64 len, bool freeit)
 {
     uint64 start = va;
     uint64 end = va + len;
-    for (; start < end; start += PGSIZE) {
-        pte_t* pte = vm_getpte(pgtbl, start, false);
+    while (start < end) {
+        pte_t* pte = vm_gethuge(pgtbl, start);
+        if (pte != NULL) {
+            if (start % HUGE_PGSIZE == 0 && end - start >= HUGE_PGSIZE) {
+                uint64 pa = PTE_TO_PA(*pte);
+                if (*pte & PTE_U) {
+                    for (int i = 0; i < 512; i++)
+                        rmap_remove(pa + i * PGSIZE, pgtbl, start + i * PGSIZE);
+                }
+                if (freeit)
+                    pmem_free_huge(pa);
+                *pte = 0;
+                start += HUGE_PGSIZE;
+                continue;
+            }
+            split_huge(pte);
+        }
+        pte = vm_getpte(pgtbl, start, false);
         if (!pte || !(*pte & PTE_V))
             panic("vm_unmappages: not mapped");
+        uint64 pa = PTE_TO_PA(*pte);
+        if (*pte & PTE_U)
+            rmap_remove(pa, pgtbl, start);
         if (freeit) {
-            uint64 pa = PTE_TO_PA(*pte);
-            pmem_free(pa, true);
+            // 用户页来自user_region, 其他页来自kern_region
+            pmem_free(pa, !(*pte & PTE_U));
         }
         *pte = 0; // 清除页表项
+        start += PGSIZE;
+    }
+    sfence_vma();
+}
+
+// 修改[va, va + len)内已映射页面的权限(R W X U)
+// 完整覆盖的大页原地修改, 部分覆盖的大页先拆分
+void vm_protect(pgtbl_t pgtbl, uint64 va, uint64 len, int perm)
+{
+    uint64 start = va;
+    uint64 end = va + len;
+    uint64 mask = PTE_R | PTE_W | PTE_X | PTE_U;
+    while (start < end) {
+        pte_t* pte = vm_gethuge(pgtbl, start);
+        if (pte != NULL) {
+            if (start % HUGE_PGSIZE == 0 && end - start >= HUGE_PGSIZE) {
+                *pte = (*pte & ~mask) | (perm & mask);
+                start += HUGE_PGSIZE;
+                continue;
+            }
+            split_huge(pte);
+        }
+        pte = vm_getpte(pgtbl, start, false);
+        if (pte != NULL && (*pte & PTE_V))
+            *pte = (*pte & ~mask) | (perm & mask);
+        start += PGSIZE;
     }
+    sfence_vma();
 }
 
 
@@ -89,12 +242,7 @@ void kvm_init() {
     extern char trampoline[];  // trampoline.S 中定义
     vm_mappages(kernel_pgtbl, VA_MAX - PGSIZE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 
-    // 4. 为每个CPU分配和映射内核栈
-    for (int i = 0; i < NCPU; i++) {
-        uint64 pa = (uint64)pmem_alloc(true);  // 分配物理页作为内核栈
-        if (!pa) panic("kvm_init: failed to allocate kstack");
-        vm_mappages(kernel_pgtbl, KSTACK(i), pa, PGSIZE, PTE_R | PTE_W);
-    }
+    // 4. 进程内核栈由kstack_alloc在创建进程时映射(见mem/kstack.h)
 }
 
 // 启用内核页表
@@ -0,0 +1,58 @@
+#include "mem/wss.h"
+#include "mem/pmem.h"
+#include "mem/vmem.h"
+
+// 采样一个叶子PTE, 它映射npages个页面(大页是512个), 页面年龄记录在首页上
+static void sample_leaf(pgtbl_t pgtbl, pte_t* pte, uint32 npages, wss_t* wss)
+{
+    page_t* pg = pmem_page(PTE_TO_PA(*pte));
+    if (pg == NULL)
+        return;
+
+    if (*pte & PTE_A) {
+        pg->age = 0;
+    } else if (pg->age < WSS_AGE_MAX && pg->rmap.pgtbl == pgtbl) {
+        // 共享页面只由第一个映射者推进年龄, 避免一个周期内被加多次
+        pg->age++;
+    }
+    if (*pte & PTE_D)
+        wss->dirty += npages;
+    *pte &= ~(PTE_A | PTE_D);
+    wss->hist[pg->age] += npages;
+}
+
+void wss_sample(uint64* pgtbl, wss_t* wss)
+{
+    memset(wss->hist, 0, sizeof(wss->hist));
+    wss->dirty = 0;
+
+    for (int i = 0; i < 512; i++) {
+        if (!(pgtbl[i] & PTE_V) || !PTE_CHECK(pgtbl[i]))
+            continue;
+        pgtbl_t mid = (pgtbl_t)PTE_TO_PA(pgtbl[i]);
+        for (int j = 0; j < 512; j++) {
+            pte_t* pte = &mid[j];
+            if (!(*pte & PTE_V))
+                continue;
+            if (!PTE_CHECK(*pte)) {
+                if (*pte & PTE_U)
+                    sample_leaf(pgtbl, pte, HUGE_PAGES, wss);
+                continue;
+            }
+            pgtbl_t low = (pgtbl_t)PTE_TO_PA(*pte);
+            for (int k = 0; k < 512; k++) {
+                if ((low[k] & PTE_V) && (low[k] & PTE_U))
+                    sample_leaf(pgtbl, &low[k], 1, wss);
+            }
+        }
+    }
+    wss->samples++;
+}
+
+uint32 wss_size(wss_t* wss, uint32 n)
+{
+    uint32 size = 0;
+    for (uint32 i = 0; i < n && i < WSS_BUCKETS; i++)
+        size += wss->hist[i];
+    return size;
+}
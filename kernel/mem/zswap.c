@@ -0,0 +1,153 @@
+#include "mem/zswap.h"
+#include "mem/swap.h"
+#include "mem/pmem.h"
+#include "lib/lz.h"
+#include "lib/print.h"
+
+// 一个被压缩的页面: 存放在pool[page]的[chunk, chunk + nchunks)块中
+typedef struct zswap_entry {
+    uint16 page;
+    uint8  chunk;
+    uint8  nchunks;
+    uint16 len;      // 压缩后的字节数, 0表示没有缓存
+} zswap_entry_t;
+
+static spinlock_t zswap_lk;                    // 保护下面所有字段
+static uint64 pool[ZSWAP_POOL_PAGES];          // 压缩池页面(0表示尚未申请)
+static uint32 pool_map[ZSWAP_POOL_PAGES];      // 每个池页的块占用位图
+static zswap_entry_t entries[SWAP_SLOTS_MAX];  // 以交换槽号为索引
+static uint16 lz_table[LZ_HASH_SIZE];          // 压缩工作区
+static uint8  comp_buf[ZSWAP_MAX_LEN];         // 压缩输出缓冲区
+static zswap_stat_t stat;
+
+void zswap_init()
+{
+    spinlock_init(&zswap_lk, "zswap");
+}
+
+// 在pool_map中找连续n个空闲块, 返回起始块号, 没有返回-1
+static int find_chunks(uint32 map, uint32 n)
+{
+    uint32 mask = (n == 32) ? 0xffffffff : ((1u << n) - 1);
+    for (uint32 i = 0; i + n <= ZSWAP_CHUNKS; i++) {
+        if ((map & (mask << i)) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// 申请n个连续块(持有zswap_lk), 成功返回true并填写e的位置
+static bool pool_alloc(uint32 n, zswap_entry_t* e)
+{
+    int empty = -1;
+    for (int i = 0; i < ZSWAP_POOL_PAGES; i++) {
+        if (pool[i] == 0) {
+            if (empty < 0)
+                empty = i;
+            continue;
+        }
+        int c = find_chunks(pool_map[i], n);
+        if (c >= 0) {
+            e->page = i;
+            e->chunk = c;
+            goto found;
+        }
+    }
+    // 已有的池页都放不下, 再申请一个内核页
+    if (empty < 0 || (pool[empty] = (uint64)pmem_alloc(true)) == 0)
+        return false;
+    stat.pool_pages++;
+    e->page = empty;
+    e->chunk = 0;
+
+found:
+    e->nchunks = n;
+    pool_map[e->page] |= (((n == 32) ? 0xffffffff : ((1u << n) - 1)) << e->chunk);
+    return true;
+}
+
+// 释放e占用的块, 池页空了就还给kern_region (持有zswap_lk)
+static void pool_free(zswap_entry_t* e)
+{
+    uint32 n = e->nchunks;
+    pool_map[e->page] &= ~(((n == 32) ? 0xffffffff : ((1u << n) - 1)) << e->chunk);
+    if (pool_map[e->page] == 0) {
+        pmem_free(pool[e->page], true);
+        pool[e->page] = 0;
+        stat.pool_pages--;
+    }
+}
+
+static void entry_drop(zswap_entry_t* e)
+{
+    pool_free(e);
+    stat.entries--;
+    stat.orig_bytes -= PGSIZE;
+    stat.comp_bytes -= e->len;
+    e->len = 0;
+}
+
+bool zswap_store(uint32 slot, uint64 pa)
+{
+    if (slot >= SWAP_SLOTS_MAX)
+        return false;
+
+    spinlock_acquire(&zswap_lk);
+    zswap_entry_t* e = &entries[slot];
+    assert(e->len == 0, "zswap_store: slot in use");
+
+    uint32 len = lz_compress((uint8*)pa, PGSIZE, comp_buf, ZSWAP_MAX_LEN, lz_table);
+    if (len == 0 || !pool_alloc((len + ZSWAP_CHUNK - 1) / ZSWAP_CHUNK, e)) {
+        stat.rejected++;
+        spinlock_release(&zswap_lk);
+        return false;
+    }
+    memmove((void*)(pool[e->page] + e->chunk * ZSWAP_CHUNK), comp_buf, len);
+    e->len = len;
+
+    stat.stored++;
+    stat.entries++;
+    stat.orig_bytes += PGSIZE;
+    stat.comp_bytes += len;
+    spinlock_release(&zswap_lk);
+    return true;
+}
+
+bool zswap_load(uint32 slot, uint64 pa)
+{
+    if (slot >= SWAP_SLOTS_MAX)
+        return false;
+
+    spinlock_acquire(&zswap_lk);
+    zswap_entry_t* e = &entries[slot];
+    if (e->len == 0) {
+        stat.misses++;
+        spinlock_release(&zswap_lk);
+        return false;
+    }
+    uint8* src = (uint8*)(pool[e->page] + e->chunk * ZSWAP_CHUNK);
+    if (lz_decompress(src, e->len, (uint8*)pa, PGSIZE) != PGSIZE)
+        panic("zswap_load: corrupted entry");
+    stat.hits++;
+    // 共享的交换槽还可能被其他交换项换入, 条目保留到zswap_invalidate
+    spinlock_release(&zswap_lk);
+    return true;
+}
+
+void zswap_invalidate(uint32 slot)
+{
+    if (slot >= SWAP_SLOTS_MAX)
+        return;
+
+    spinlock_acquire(&zswap_lk);
+    if (entries[slot].len != 0)
+        entry_drop(&entries[slot]);
+    spinlock_release(&zswap_lk);
+}
+
+void zswap_get_stat(zswap_stat_t* st)
+{
+    spinlock_acquire(&zswap_lk);
+    *st = stat;
+    spinlock_release(&zswap_lk);
+}
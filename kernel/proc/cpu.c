@@ -1,4 +1,6 @@
 #include "proc/cpu.h"
+#include "lib/lock.h"
+#include "memlayout.h"
 #include "riscv.h"
 
 static cpu_t cpus[NCPU];
@@ -9,12 +11,31 @@ cpu_t* mycpu(void)
     return &cpus[id];
 }
 
+cpu_t* cpu_get(int id)
+{
+    return &cpus[id];
+}
+
 int mycpuid(void)
 {
     return r_tp();
 }
 
+// 关中断读取, 避免读到一半被调度到另一个hart上
 proc_t* myproc(void)
 {
-    return mycpu()->proc;
-}
\ No newline at end of file
+    push_off();
+    proc_t* p = mycpu()->proc;
+    pop_off();
+    return p;
+}
+
+/*
+    处理器间中断:
+    写目标hart的CLINT_MSIP, 目标hart进入M-mode软件中断
+    M-mode处理程序(timer_vector)清除MSIP并引发S-mode软件中断, 打断目标hart的wfi
+*/
+void ipi_send(int cpuid)
+{
+    *(volatile uint32*)CLINT_MSIP(cpuid) = 1;
+}
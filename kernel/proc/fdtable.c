@@ -0,0 +1,97 @@
+#include "proc/fdtable.h"
+#include "mem/kcache.h"
+#include "fs/file.h"
+#include "lib/print.h"
+
+static kcache_t fdtable_cache;
+
+void fdtable_init()
+{
+    kcache_init(&fdtable_cache, "fdtable", sizeof(fdtable_t));
+}
+
+fdtable_t* fdtable_alloc()
+{
+    fdtable_t* fdt = kcache_alloc(&fdtable_cache);
+    if (fdt == NULL)
+        return NULL;
+    spinlock_init(&fdt->lk, "fdtable");
+    fdt->ref = 1;
+    for (int i = 0; i < FILE_PER_PROC; i++)
+        fdt->list[i] = NULL;
+    return fdt;
+}
+
+// fdt是刚申请的空表, 还没有被其他线程看到
+void fdtable_copy(fdtable_t* fdt, fdtable_t* old)
+{
+    spinlock_acquire(&old->lk);
+    for (int i = 0; i < FILE_PER_PROC; i++) {
+        if (old->list[i] != NULL)
+            fdt->list[i] = file_dup(old->list[i]);
+    }
+    spinlock_release(&old->lk);
+}
+
+fdtable_t* fdtable_get(fdtable_t* fdt)
+{
+    spinlock_acquire(&fdt->lk);
+    assert(fdt->ref > 0, "fdtable_get: free table");
+    fdt->ref++;
+    spinlock_release(&fdt->lk);
+    return fdt;
+}
+
+void fdtable_put(fdtable_t* fdt)
+{
+    spinlock_acquire(&fdt->lk);
+    assert(fdt->ref > 0, "fdtable_put: free table");
+    if (fdt->ref > 1) {
+        fdt->ref--;
+        spinlock_release(&fdt->lk);
+        return;
+    }
+    spinlock_release(&fdt->lk);
+
+    // 最后一个引用: 没有人能再访问这张表, 关闭文件之后才把它还给缓存
+    for (int i = 0; i < FILE_PER_PROC; i++) {
+        if (fdt->list[i] != NULL)
+            file_close(fdt->list[i]);
+    }
+    kcache_free(&fdtable_cache, fdt);
+}
+
+int fdtable_install(fdtable_t* fdt, file_t* file)
+{
+    spinlock_acquire(&fdt->lk);
+    for (int fd = 0; fd < FILE_PER_PROC; fd++) {
+        if (fdt->list[fd] == NULL) {
+            fdt->list[fd] = file;
+            spinlock_release(&fdt->lk);
+            return fd;
+        }
+    }
+    spinlock_release(&fdt->lk);
+    return -1;
+}
+
+file_t* fdtable_lookup(fdtable_t* fdt, int fd)
+{
+    if (fd < 0 || fd >= FILE_PER_PROC)
+        return NULL;
+    spinlock_acquire(&fdt->lk);
+    file_t* file = fdt->list[fd];
+    spinlock_release(&fdt->lk);
+    return file;
+}
+
+file_t* fdtable_remove(fdtable_t* fdt, int fd)
+{
+    if (fd < 0 || fd >= FILE_PER_PROC)
+        return NULL;
+    spinlock_acquire(&fdt->lk);
+    file_t* file = fdt->list[fd];
+    fdt->list[fd] = NULL;
+    spinlock_release(&fdt->lk);
+    return file;
+}
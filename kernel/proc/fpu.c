@@ -0,0 +1,62 @@
+#include "proc/fpu.h"
+#include "proc/cpu.h"
+#include "lib/str.h"
+#include "lib/print.h"
+#include "riscv.h"
+
+static void fpu_set_fs(uint64 fs)
+{
+    w_sstatus((r_sstatus() & ~SSTATUS_FS) | fs);
+}
+
+// 寄存器里是不是p的浮点状态
+static bool fpu_owned(proc_t* p)
+{
+    return mycpu()->fpu_owner == p && p->fpu_cpu == mycpuid();
+}
+
+// 只有Dirty才需要保存: Clean说明寄存器与p->fpu一致, Off说明它没有使用浮点单元
+void fpu_switch_out(proc_t* p)
+{
+    if (!p->fpu_used || (r_sstatus() & SSTATUS_FS) != SSTATUS_FS_DIRTY)
+        return;
+    assert(fpu_owned(p), "fpu_switch_out: not owner");
+    fpu_save(&p->fpu);
+    fpu_set_fs(SSTATUS_FS_CLEAN);
+}
+
+uint64 fpu_user_return(proc_t* p)
+{
+    if (!p->fpu_used)
+        return SSTATUS_FS_OFF;
+    // 寄存器还是它的: 只有从未切换离开时才可能是Dirty(切换离开时已经保存并改成Clean)
+    if (fpu_owned(p)) {
+        uint64 fs = r_sstatus() & SSTATUS_FS;
+        return fs == SSTATUS_FS_DIRTY ? fs : SSTATUS_FS_CLEAN;
+    }
+    fpu_set_fs(SSTATUS_FS_CLEAN);
+    fpu_restore(&p->fpu);
+    mycpu()->fpu_owner = p;
+    p->fpu_cpu = mycpuid();
+    return SSTATUS_FS_CLEAN;
+}
+
+// 非法指令异常发生时FS为Off且进程还没有用过浮点: 认为是第一次执行浮点指令
+// 给它一份清零的状态, 返回用户态时装入寄存器, 然后重新执行这条指令
+// 如果这条指令并不是浮点指令, 重新执行时还会触发异常, 那时按真正的非法指令处理
+bool fpu_first_use(proc_t* p)
+{
+    if (p->fpu_used || (r_sstatus() & SSTATUS_FS) != SSTATUS_FS_OFF)
+        return false;
+    memset(&p->fpu, 0, sizeof(p->fpu));
+    p->fpu_cpu = -1;
+    p->fpu_used = true;
+    return true;
+}
+
+void fpu_flush(proc_t* p)
+{
+    push_off();
+    fpu_switch_out(p);
+    pop_off();
+}
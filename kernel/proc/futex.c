@@ -0,0 +1,222 @@
+#include "proc/futex.h"
+#include "proc/cpu.h"
+#include "mem/pmem.h"
+#include "mem/vmem.h"
+#include "lib/print.h"
+#include "riscv.h"
+
+// 一个等待者, 位于睡眠进程的内核栈上
+typedef struct futex_waiter {
+    uint64 key;                  // 锁字的物理地址(转移时改写)
+    bool woken;                  // 已经从桶中摘除
+    struct futex_waiter* next;
+} futex_waiter_t;
+
+typedef struct futex_bucket {
+    spinlock_t lk;               // 保护链表和其中等待者的key、woken
+    futex_waiter_t* head;        // 最早开始等待的
+    futex_waiter_t* tail;
+} futex_bucket_t;
+
+static futex_bucket_t buckets[FUTEX_HASH];
+
+static futex_bucket_t* bucket_of(uint64 key)
+{
+    return &buckets[((key >> 2) ^ (key >> 12)) % FUTEX_HASH];
+}
+
+void futex_init()
+{
+    for (int i = 0; i < FUTEX_HASH; i++) {
+        spinlock_init(&buckets[i].lk, "futex");
+        buckets[i].head = NULL;
+        buckets[i].tail = NULL;
+    }
+}
+
+// 把当前进程的用户地址翻译成等待键(调用者持有mm->lk)
+// 先换入页面并解除写时复制, 之后页面是可写的私有页面, 等待者和唤醒者翻译出同一个物理地址
+// 地址未对齐或没有映射用户页面时返回0
+static uint64 futex_key(proc_t* p, uint64 uaddr)
+{
+    if (uaddr % sizeof(uint32) != 0 || uaddr >= MMAP_END)
+        return 0;
+    uvm_fault(p->pgtbl, uaddr, true);
+    uint64 pa = vm_walkaddr(p->pgtbl, uaddr);
+    if (pa == 0 || pmem_page(PG_ROUND_DOWN(pa)) == NULL)
+        return 0;
+    return pa;
+}
+
+// 从桶中摘除w (持有桶锁)
+static void bucket_remove(futex_bucket_t* b, futex_waiter_t* w, futex_waiter_t* prev)
+{
+    if (prev != NULL)
+        prev->next = w->next;
+    else
+        b->head = w->next;
+    if (b->tail == w)
+        b->tail = prev;
+    w->next = NULL;
+}
+
+// 挂到桶的队尾 (持有桶锁)
+static void bucket_append(futex_bucket_t* b, futex_waiter_t* w)
+{
+    w->next = NULL;
+    if (b->tail != NULL)
+        b->tail->next = w;
+    else
+        b->head = w;
+    b->tail = w;
+}
+
+// 持有b的锁时换成w当前所在的桶并锁住它, 返回这个桶
+// 转移者同时持有新旧两个桶锁改写key, 持有其中任何一个都能读到稳定的key
+static futex_bucket_t* waiter_lock(futex_waiter_t* w, futex_bucket_t* b)
+{
+    futex_bucket_t* cur;
+    while ((cur = bucket_of(w->key)) != b) {
+        spinlock_release(&b->lk);
+        spinlock_acquire(&cur->lk);
+        b = cur;
+    }
+    return b;
+}
+
+// 唤醒b中键为key的最多n个等待者 (持有桶锁)
+static int bucket_wake(futex_bucket_t* b, uint64 key, uint32 n)
+{
+    int woken = 0;
+    futex_waiter_t* prev = NULL;
+    futex_waiter_t* w = b->head;
+    while (w != NULL && woken < n) {
+        futex_waiter_t* next = w->next;
+        if (w->key != key) {
+            prev = w;
+            w = next;
+            continue;
+        }
+        bucket_remove(b, w, prev);
+        w->woken = true;
+        proc_wakeup(w);
+        woken++;
+        w = next;
+    }
+    return woken;
+}
+
+int futex_wait(uint64 uaddr, uint32 val)
+{
+    proc_t* p = myproc();
+    futex_waiter_t w;
+
+    // 固定页面之前一直持有mm->lk: 同一地址空间的其他线程不能撤掉这个页面
+    mm_lock(p->mm);
+    w.key = futex_key(p, uaddr);
+    if (w.key == 0) {
+        mm_unlock(p->mm);
+        return -1;
+    }
+    futex_bucket_t* b = bucket_of(w.key);
+    spinlock_acquire(&b->lk);
+
+    // 唤醒者先修改锁字再拿桶锁, 在桶锁下检查锁字就不会错过唤醒
+    if (*(volatile uint32*)w.key != val) {
+        spinlock_release(&b->lk);
+        mm_unlock(p->mm);
+        return -1;
+    }
+    // 等待期间固定页面, 物理地址(也就是键)保持不变
+    pmem_get(PG_ROUND_DOWN(w.key));
+    w.woken = false;
+    bucket_append(b, &w);
+    mm_unlock(p->mm);
+
+    // 唤醒者在桶锁下摘除等待者之后才会唤醒, 被转移到其他桶也一样
+    // 栈上的w可能收到属于别人的迟到唤醒(同一地址以前的主人), 醒来后在当前所在的桶锁下重新检查
+    while (!w.woken) {
+        proc_sleep(&w, &b->lk);
+        b = waiter_lock(&w, b);
+    }
+    spinlock_release(&b->lk);
+
+    // 转移后键可能已经改变, 固定的是最后所在的页面
+    pmem_free(PG_ROUND_DOWN(w.key), false);
+    return 0;
+}
+
+int futex_wake(uint64 uaddr, uint32 nwake)
+{
+    proc_t* p = myproc();
+
+    mm_lock(p->mm);
+    uint64 key = futex_key(p, uaddr);
+    mm_unlock(p->mm);
+    if (key == 0)
+        return -1;
+
+    // 有等待者时页面被固定, 键在这里不会失效; 没有等待者时键变化也无所谓
+    futex_bucket_t* b = bucket_of(key);
+    spinlock_acquire(&b->lk);
+    int woken = bucket_wake(b, key, nwake);
+    spinlock_release(&b->lk);
+    return woken;
+}
+
+// 唤醒uaddr上的nwake个等待者, 剩下的最多nmove个转移到uaddr2上等待
+// 用于条件变量广播: 只唤醒一个去抢互斥锁, 其他的直接排到互斥锁上, 避免惊群
+int futex_requeue(uint64 uaddr, uint32 nwake, uint64 uaddr2, uint32 nmove)
+{
+    proc_t* p = myproc();
+
+    mm_lock(p->mm);
+    uint64 key = futex_key(p, uaddr);
+    uint64 key2 = futex_key(p, uaddr2);
+    if (key == 0 || key2 == 0) {
+        mm_unlock(p->mm);
+        return -1;
+    }
+    futex_bucket_t* b = bucket_of(key);
+    futex_bucket_t* b2 = bucket_of(key2);
+    // 两个桶按地址顺序加锁
+    if (b < b2) {
+        spinlock_acquire(&b->lk);
+        spinlock_acquire(&b2->lk);
+    } else if (b > b2) {
+        spinlock_acquire(&b2->lk);
+        spinlock_acquire(&b->lk);
+    } else {
+        spinlock_acquire(&b->lk);
+    }
+
+    int n = bucket_wake(b, key, nwake);
+
+    uint32 moved = 0;
+    futex_waiter_t* prev = NULL;
+    futex_waiter_t* w = b->head;
+    while (w != NULL && moved < nmove && key != key2) {
+        futex_waiter_t* next = w->next;
+        if (w->key != key) {
+            prev = w;
+            w = next;
+            continue;
+        }
+        bucket_remove(b, w, prev);
+        // 固定关系跟着等待者转到新页面上
+        pmem_get(PG_ROUND_DOWN(key2));
+        pmem_free(PG_ROUND_DOWN(key), false);
+        w->key = key2;
+        bucket_append(b2, w);
+        moved++;
+        // 同一个桶时转移过来的等待者排在队尾, 扫描到它时键已经不同, 会被跳过
+        w = next;
+    }
+
+    if (b != b2)
+        spinlock_release(&b2->lk);
+    spinlock_release(&b->lk);
+    // 转移时要固定key2所在的页面, 一直持有mm->lk到这里
+    mm_unlock(p->mm);
+    return n + moved;
+}
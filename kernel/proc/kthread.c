@@ -0,0 +1,28 @@
+#include "proc/kthread.h"
+#include "proc/cpu.h"
+#include "proc/sched.h"
+#include "lib/print.h"
+
+// 内核线程第一次被调度时从这里开始
+static void kthread_entry()
+{
+    // 切换过来时持有p->lk和上一个进程的锁
+    proc_switch_finish();
+    proc_t* p = myproc();
+    spinlock_release(&p->lk);
+
+    p->kfn(p->karg);
+    proc_exit(0);
+}
+
+proc_t* kthread_create(void (*fn)(void*), void* arg)
+{
+    proc_t* p = proc_alloc_kernel(kthread_entry);
+    if (p == NULL)
+        return NULL;
+    p->kfn = fn;
+    p->karg = arg;
+    sched_ready(p, sched_pick_cpu(p));
+    spinlock_release(&p->lk);
+    return p;
+}
@@ -0,0 +1,104 @@
+#include "proc/mm.h"
+#include "mem/kcache.h"
+#include "mem/vmem.h"
+#include "lib/str.h"
+#include "lib/print.h"
+
+static kcache_t mm_cache;
+static spinlock_t mm_list_lk;  // 保护存活描述符链表和所有描述符的ref
+static mm_t* mm_list;
+
+void mm_init()
+{
+    spinlock_init(&mm_list_lk, "mm_list");
+    kcache_init(&mm_cache, "mm", sizeof(mm_t));
+    mm_list = NULL;
+}
+
+mm_t* mm_alloc(uint64* pgtbl)
+{
+    mm_t* mm = kcache_alloc(&mm_cache);
+    if (mm == NULL)
+        return NULL;
+    sleeplock_init(&mm->lk, "mm");
+    mm->ref = 1;
+    mm->pgtbl = pgtbl;
+    mm->heap_top = 0;
+    mm->ustack_pages = 0;
+    mm->mmap = NULL;
+    memset(&mm->wss, 0, sizeof(mm->wss));
+    mm->wss_pending = false;
+
+    spinlock_acquire(&mm_list_lk);
+    mm->prev = NULL;
+    mm->next = mm_list;
+    if (mm_list != NULL)
+        mm_list->prev = mm;
+    mm_list = mm;
+    spinlock_release(&mm_list_lk);
+    return mm;
+}
+
+mm_t* mm_get(mm_t* mm)
+{
+    spinlock_acquire(&mm_list_lk);
+    assert(mm->ref > 0, "mm_get: free mm");
+    mm->ref++;
+    spinlock_release(&mm_list_lk);
+    return mm;
+}
+
+// 最后一个引用放掉时销毁用户页表(调用者可能持有p->lk, 这里不能睡眠)
+void mm_put(mm_t* mm)
+{
+    spinlock_acquire(&mm_list_lk);
+    assert(mm->ref > 0, "mm_put: free mm");
+    if (--mm->ref > 0) {
+        spinlock_release(&mm_list_lk);
+        return;
+    }
+    // 摘出链表之后遍历者再也看不到它
+    if (mm->prev != NULL)
+        mm->prev->next = mm->next;
+    else
+        mm_list = mm->next;
+    if (mm->next != NULL)
+        mm->next->prev = mm->prev;
+    spinlock_release(&mm_list_lk);
+
+    if (mm->pgtbl != NULL)
+        uvm_destroy_pgtbl(mm->pgtbl, 3); // 用户页表是3级页表
+    kcache_free(&mm_cache, mm);
+}
+
+/*
+    遍历所有存活的地址空间: for (mm = mm_next(NULL); mm != NULL; mm = mm_next(mm))
+    返回的描述符被遍历者持有一个引用, 在下一次调用之前不会被销毁, 也不会离开链表
+    遍历途中最后一个线程退出时由遍历者的mm_put销毁页表
+*/
+mm_t* mm_next(mm_t* mm)
+{
+    spinlock_acquire(&mm_list_lk);
+    mm_t* next = mm != NULL ? mm->next : mm_list;
+    if (next != NULL)
+        next->ref++;
+    spinlock_release(&mm_list_lk);
+    if (mm != NULL)
+        mm_put(mm);
+    return next;
+}
+
+void mm_lock(mm_t* mm)
+{
+    sleeplock_acquire(&mm->lk);
+}
+
+void mm_unlock(mm_t* mm)
+{
+    sleeplock_release(&mm->lk);
+}
+
+bool mm_holding(mm_t* mm)
+{
+    return sleeplock_holding(&mm->lk);
+}
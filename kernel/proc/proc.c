@@ -1,11 +1,17 @@
 #include "lib/print.h"
 #include "mem/pmem.h"
 #include "mem/vmem.h"
+#include "mem/swap.h"
+#include "mem/kstack.h"
+#include "mem/kcache.h"
 #include "proc/cpu.h"
+#include "proc/sched.h"
+#include "proc/futex.h"
 #include "proc/initcode.h"
 #include "memlayout.h"
 #include "proc/proc.h"
 #include "dev/timer.h"
+#include "dev/twheel.h"
 #include "riscv.h"
 #include "lib/str.h"
 #include "fs/file.h"
@@ -24,11 +30,106 @@ extern void swtch(context_t* old, context_t* new);
 // in trap_user.c
 extern void trap_user_return();
 
-static proc_t procs[NPROC];
+/*
+    进程表: 进程描述符按需从对象缓存中申请, 进程被回收后归还缓存
+    - 空闲(UNUSED)的描述符在缓存的空闲链里, 申请和归还都是O(1)
+    - 存活的描述符串在all_next链表上, 周期性的全表操作(优先级提升、固定地址空间)遍历它
+    - 同时按pid散列到PID_HASH个桶中, 按pid查找(亲和性、工作集等)只检查一个桶
+    - RUNNABLE的进程在运行队列里, SLEEPING的在睡眠队列里, ZOMBIE的在父进程的子进程链表里
+
+    ptable_lk保护存活链表和pid散列表
+    加锁顺序: ptable_lk -> p->lk; 持有p->lk时只能尝试获取ptable_lk(见proc_pin)
+    描述符归还之前先摘出进程表, 再等待已经找到它的人放开p->lk(见proc_discard)
+*/
+#define PID_HASH 256
+
+static kcache_t proc_cache;
+static spinlock_t ptable_lk;
+static proc_t* ptable_head;             // 存活进程链表
+static proc_t* pid_hash[PID_HASH];
 
 // 第一个进程的指针
 static proc_t* proczero;
 
+// 把新进程加入进程表
+static void ptable_insert(proc_t* p)
+{
+    proc_t** bucket = &pid_hash[(uint32)p->pid % PID_HASH];
+    spinlock_acquire(&ptable_lk);
+    p->all_prev = NULL;
+    p->all_next = ptable_head;
+    if (ptable_head != NULL)
+        ptable_head->all_prev = p;
+    ptable_head = p;
+    p->pid_next = *bucket;
+    *bucket = p;
+    spinlock_release(&ptable_lk);
+}
+
+// 把描述符摘出进程表并归还缓存(p已经被proc_free释放, 调用者不能持有p->lk)
+static void proc_discard(proc_t* p)
+{
+    spinlock_acquire(&ptable_lk);
+    if (p->all_prev != NULL)
+        p->all_prev->all_next = p->all_next;
+    else
+        ptable_head = p->all_next;
+    if (p->all_next != NULL)
+        p->all_next->all_prev = p->all_prev;
+    proc_t** pp = &pid_hash[(uint32)p->pid % PID_HASH];
+    while (*pp != p)
+        pp = &(*pp)->pid_next;
+    *pp = p->pid_next;
+    spinlock_release(&ptable_lk);
+
+    // 摘除之前找到它的人可能还持有p->lk(它们会看到UNUSED而放弃), 等它们放开
+    spinlock_acquire(&p->lk);
+    spinlock_release(&p->lk);
+    kcache_free(&proc_cache, p);
+}
+
+/*
+    睡眠队列: 睡眠的进程按等待的channel散列到SLEEPQ_HASH个桶中
+    唤醒时只检查同一个桶里的进程, 而不是扫描整个进程表
+    每个桶是FIFO链表, 排他唤醒(proc_wakeup_one)总是叫醒等得最久的进程
+
+    加锁顺序: 条件锁 -> 桶锁 -> p->lk
+    睡眠者在桶锁下挂入队列并拿到p->lk, 一直持有p->lk直到切换离开
+    所以唤醒者在桶里看到它之后, 拿到p->lk时它一定已经处于SLEEPING
+*/
+#define SLEEPQ_HASH 64
+
+typedef struct sleepq {
+    spinlock_t lk;   // 保护队列和其中进程的sleep_next
+    proc_t* head;    // 最早睡眠的进程
+    proc_t* tail;
+} sleepq_t;
+
+static sleepq_t sleepq[SLEEPQ_HASH];
+
+static sleepq_t* sleepq_of(void* chan)
+{
+    uint64 x = (uint64)chan;
+    return &sleepq[((x >> 3) ^ (x >> 12)) % SLEEPQ_HASH];
+}
+
+/*
+    父子关系: 每个进程的子进程串成一条单向链表(children -> sibling -> ...)
+    wait_lk保护所有进程的parent、children、sibling字段
+    加锁顺序: wait_lk -> p->lk
+*/
+static spinlock_t wait_lk;
+
+// 把p挂到parent的子进程链表上(不能持有p->lk)
+static void proc_set_parent(proc_t* p, proc_t* parent)
+{
+    spinlock_acquire(&wait_lk);
+    p->parent = parent;
+    p->sibling = parent->children;
+    parent->children = p;
+    spinlock_release(&wait_lk);
+}
+
 // 全局的pid和保护它的锁 
 static int global_pid = 1;
 static spinlock_t lk_pid;
@@ -50,6 +151,7 @@ static void fork_return()
 {
     static int first = 1;
     // 由于调度器中上了锁，所以这里需要解锁
+    proc_switch_finish();
     proc_t* p = myproc();
     spinlock_release(&p->lk);
 
@@ -57,6 +159,7 @@ static void fork_return()
         // 文件系统初始化必须在进程上下文中运行
         // 因为它可能调用sleep等函数，不能在main()中运行
         fs_init();
+        swap_init();
         first = 0;
         // 确保其他核心看到first=0
         __sync_synchronize();
@@ -68,64 +171,70 @@ static void fork_return()
 // 进程模块初始化
 void proc_init()
 {
-    // 初始化 pid 分配锁
+    // 初始化 pid 分配锁、父子关系锁和进程表
     spinlock_init(&lk_pid, "pid");
-
-    // 初始化进程表中的所有进程
-    for (int i = 0; i < NPROC; i++) {
-        spinlock_init(&procs[i].lk, "proc");
-
-        // 初始化进程状态为未使用
-        procs[i].state = UNUSED;
-        procs[i].pid = 0;
-        procs[i].parent = NULL;
-        procs[i].exit_state = 0;
-        procs[i].sleep_space = NULL;
-        procs[i].pgtbl = NULL;
-        procs[i].tf = NULL;
-        procs[i].kstack = 0;
-        procs[i].heap_top = 0;
-        procs[i].ustack_pages = 0;
-        procs[i].mmap = NULL;
-
-        // 初始化时间片字段
-        procs[i].time_slice = TIME_SLICE;
-        procs[i].total_time = 0;
+    spinlock_init(&wait_lk, "wait");
+    spinlock_init(&ptable_lk, "ptable");
+    kcache_init(&proc_cache, "proc", sizeof(proc_t));
+    // 初始化每个CPU的运行队列和睡眠队列
+    sched_init();
+    // 线程共享的地址空间和文件描述符表
+    mm_init();
+    fdtable_init();
+    // 用户态锁的等待队列
+    futex_init();
+    for (int i = 0; i < SLEEPQ_HASH; i++) {
+        spinlock_init(&sleepq[i].lk, "sleepq");
+        sleepq[i].head = NULL;
+        sleepq[i].tail = NULL;
     }
 }
 
-// 进程申请 - 基于xv6的allocproc实现
-proc_t* proc_alloc()
+// 申请一个进程描述符, 完成与用户地址空间无关的初始化(pid、调度字段、内核栈)并加入进程表
+// 成功时返回持有p->lk的进程, 上下文从内核栈顶开始, 入口由调用者设置
+static proc_t* proc_slot_alloc()
 {
-    proc_t* p;
-
-    for (p = procs; p < &procs[NPROC]; p++) {
-        spinlock_acquire(&p->lk);
-        if (p->state == UNUSED) {
-            goto found;
-        } else {
-            spinlock_release(&p->lk);
-        }
+    // 加入进程表之前其他CPU看不到它, 初始化不需要加锁
+    proc_t* p = kcache_alloc(&proc_cache);
+    if (p == NULL)
+        return NULL;
+    memset(p, 0, sizeof(*p));
+    spinlock_init(&p->lk, "proc");
+    p->state = USED;
+
+    // 从最高优先级层开始(fork时改为继承父进程的nice)
+    p->prio = 0;
+    p->nice = 0;
+    proc_reset_time_slice(p);
+    p->cpumask = CPU_MASK_ALL;
+    p->fpu_cpu = -1;
+    p->stat_last_cpu = -1;
+
+    // 分配内核栈(优先复用缓存里的栈)
+    if ((p->kstack = kstack_alloc()) == 0) {
+        kcache_free(&proc_cache, p);
+        return NULL;
     }
-    return NULL;
+    p->ctx.sp = p->kstack + KSTACK_SIZE;
 
-found:
     p->pid = alloc_pid();
-    p->state = RUNNABLE;
-
-    // 初始化文件描述符表
-    for (int i = 0; i < FILE_PER_PROC; i++) {
-        p->filelist[i] = NULL;
-    }
+    ptable_insert(p);
+    spinlock_acquire(&p->lk);
+    return p;
+}
 
-    // 初始化时间片
-    p->time_slice = TIME_SLICE;
-    p->total_time = 0;
+// 进程申请 - 基于xv6的allocproc实现
+proc_t* proc_alloc()
+{
+    proc_t* p = proc_slot_alloc();
+    if (p == NULL)
+        return NULL;
 
     // 分配 trapframe 页面
     if ((p->tf = (trapframe_t*)pmem_alloc(true)) == NULL) {
         proc_free(p);
         spinlock_release(&p->lk);
+        proc_discard(p);
         return NULL;
     }
 
@@ -134,40 +243,72 @@ found:
     if (p->pgtbl == NULL) {
         proc_free(p);
         spinlock_release(&p->lk);
+        proc_discard(p);
         return NULL;
     }
+    p->tf_va = TRAPFRAME;
 
-    // 设置内核栈（在procinit中已经预分配）
-    p->kstack = KSTACK((int)(p - procs));
+    // 地址空间和文件描述符表归这个进程(及以后clone出的线程)所有
+    if ((p->mm = mm_alloc(p->pgtbl)) == NULL || (p->files = fdtable_alloc()) == NULL) {
+        proc_free(p);
+        spinlock_release(&p->lk);
+        proc_discard(p);
+        return NULL;
+    }
 
     // 设置新的上下文，从fork_return开始执行
-    memset(&p->ctx, 0, sizeof(p->ctx));
     p->ctx.ra = (uint64)fork_return;
-    p->ctx.sp = p->kstack + PGSIZE;
 
     return p;
 }
 
+// 申请一个内核线程: 没有用户页表和trapframe, 只有内核栈
+// 上下文从entry开始执行, 父进程是第一个进程(退出后由它回收)
+// 成功时返回持有p->lk的进程
+proc_t* proc_alloc_kernel(void (*entry)())
+{
+    proc_t* p = proc_slot_alloc();
+    if (p == NULL)
+        return NULL;
+    p->ctx.ra = (uint64)entry;
+    // 进程处于USED状态, 暂时放开锁不会被调度
+    spinlock_release(&p->lk);
+    proc_set_parent(p, proczero);
+    spinlock_acquire(&p->lk);
+    return p;
+}
+
 // 进程释放 - 基于xv6的freeproc实现
 void proc_free(proc_t* p)
 {
+    // 地址空间可能还被其他线程使用, 先撤掉本线程trapframe的映射
+    if (p->mm && p->tf_va)
+        vm_unmappages(p->pgtbl, p->tf_va, PGSIZE, false);
+    p->tf_va = 0;
     if (p->tf)
         pmem_free((uint64)p->tf, true);
     p->tf = NULL;
-    if (p->pgtbl)
+    // 最后一个线程释放时才销毁页表
+    if (p->mm)
+        mm_put(p->mm);
+    else if (p->pgtbl)
         uvm_destroy_pgtbl(p->pgtbl, 3); // 用户页表是3级页表
+    p->mm = NULL;
     p->pgtbl = NULL;
-    p->heap_top = 0;
-    p->pid = 0;
+    if (p->files)
+        fdtable_put(p->files);
+    p->files = NULL;
+    // 进程已经切换离开(调用者持有p->lk), 不会再使用内核栈
+    if (p->kstack)
+        kstack_free(p->kstack);
+    p->kstack = 0;
+    p->kfn = NULL;
+    p->karg = NULL;
+    // pid保留到描述符摘出散列表为止(见proc_discard)
+    // 已经被父进程从链表中摘除, 子进程在退出时已经转交出去
     p->parent = NULL;
-
-    // 清理文件描述符表
-    for (int i = 0; i < FILE_PER_PROC; i++) {
-        if (p->filelist[i] != NULL) {
-            file_close(p->filelist[i]);
-            p->filelist[i] = NULL;
-        }
-    }
+    p->children = NULL;
+    p->sibling = NULL;
 
     // TODO: 实现进程名
     // p->name[0] = 0;
@@ -177,7 +318,9 @@ void proc_free(proc_t* p)
     p->exit_state = 0;
     p->state = UNUSED;
 
-    // 重置时间片字段
+    // 重置调度字段
+    p->prio = 0;
+    p->nice = 0;
     p->time_slice = TIME_SLICE;
     p->total_time = 0;
 }
@@ -222,18 +365,10 @@ pgtbl_t proc_pgtbl_init(uint64 trapframe)
 */
 void proc_make_first()
 {
-    // 使用 procs[0] 作为第一个进程
-    proc_t* p = &procs[0];
+    // 申请第一个进程的描述符(pid、调度字段和内核栈), 返回时持有锁
+    proc_t* p = proc_slot_alloc();
+    if (!p) panic("proc_make_first: failed to allocate proc");
     proczero = p;  // 设置 proczero 指向第一个进程
-    // 初始化进程锁
-    spinlock_acquire(&p->lk);
-    p->state = RUNNABLE;
-
-    // pid 设置
-    p->pid = alloc_pid();
-    // 初始化时间片
-    p->time_slice = TIME_SLICE;
-    p->total_time = 0;
 
     // 分配 trapframe 页面
     uint64 trapframe_pa = (uint64)pmem_alloc(true);
@@ -243,21 +378,27 @@ void proc_make_first()
     // pagetable 初始化 - 调用 proc_pgtbl_init 完成 trapframe 和 trampoline 的映射
     p->pgtbl = proc_pgtbl_init(trapframe_pa);
     if (!p->pgtbl) panic("proc_make_first: failed to initialize page table");
+    p->tf_va = TRAPFRAME;
+
+    // 地址空间和文件描述符表
+    p->mm = mm_alloc(p->pgtbl);
+    p->files = fdtable_alloc();
+    if (!p->mm || !p->files) panic("proc_make_first: failed to allocate mm or fdtable");
 
     // ustack 映射 + 设置 ustack_pages (分配2页栈空间)
-    uint64 ustack_pa1 = (uint64)pmem_alloc(true);
-    uint64 ustack_pa2 = (uint64)pmem_alloc(true);
+    uint64 ustack_pa1 = (uint64)pmem_alloc(false);
+    uint64 ustack_pa2 = (uint64)pmem_alloc(false);
     if (!ustack_pa1 || !ustack_pa2) panic("proc_make_first: failed to allocate user stack");
 
     // 用户栈映射到 trapframe 下方两页
     uint64 ustack_va = TRAPFRAME - 2 * PGSIZE;
     vm_mappages(p->pgtbl, ustack_va, ustack_pa1, PGSIZE, PTE_R | PTE_W | PTE_U);
     vm_mappages(p->pgtbl, ustack_va + PGSIZE, ustack_pa2, PGSIZE, PTE_R | PTE_W | PTE_U);
-    p->ustack_pages = 2;
+    p->mm->ustack_pages = 2;
 
     // data + code 映射
     assert(initcode_len <= PGSIZE, "proc_make_first: initcode too big\n");
-    uint64 code_pa = (uint64)pmem_alloc(true);
+    uint64 code_pa = (uint64)pmem_alloc(false);
     if (!code_pa) panic("proc_make_first: failed to allocate code page");
 
     // 代码页映射到虚拟地址 PGSIZE（跳过最低的一页）
@@ -268,7 +409,7 @@ void proc_make_first()
     memcpy((void*)code_pa, initcode, initcode_len);
 
     // 设置 heap_top - 代码页之后就是堆的起始位置
-    p->heap_top = code_va + 2 * PGSIZE;
+    p->mm->heap_top = code_va + 2 * PGSIZE;
 
     // tf字段设置
     memset(p->tf, 0, sizeof(trapframe_t));
@@ -283,15 +424,8 @@ void proc_make_first()
     p->tf->kernel_satp = r_satp();         // 当前内核页表
     p->tf->kernel_hartid = r_tp();         // 当前 CPU ID
 
-    // 内核字段设置
-    // 分配内核栈虚拟地址 - 使用 KSTACK 宏为当前CPU分配内核栈
-    p->kstack = KSTACK(mycpuid());
-
     // 设置 trapframe 的内核栈字段
-    p->tf->kernel_sp = p->kstack + PGSIZE;     // 内核栈指针指向栈顶
-
-    // 设置进程上下文 - 初始化为零，然后设置关键字段
-    memset(&p->ctx, 0, sizeof(context_t));
+    p->tf->kernel_sp = p->kstack + KSTACK_SIZE; // 内核栈指针指向栈顶
 
     // ra (返回地址) 设置为 trap_user_return，进程恢复时将跳转到这里
     p->tf->kernel_trap = (uint64)trap_user_return;
@@ -301,16 +435,9 @@ void proc_make_first()
     printf("proc_make_first: setting ctx.ra to fork_return (0x%p) for proc %d\n",
            (uint64)fork_return, p->pid);
 
-    // context 的 sp 设置为内核栈顶
-    p->ctx.sp = p->kstack + PGSIZE;
-
-    // 上下文切换
-    // 设置当前 CPU 的运行进程为 proczero
-    mycpu()->proc = p;
-
-    printf("proc_make_first: about to switch to first process (pid=%d)\n", p->pid);
-
-    // 不要直接释放锁，让调度器来处理
+    // 放入当前CPU的运行队列, 释放锁后调度器就可以选中它
+    sched_ready(p, mycpuid());
+    printf("proc_make_first: first process ready (pid=%d)\n", p->pid);
     spinlock_release(&p->lk);
 
 }
@@ -327,121 +454,196 @@ int proc_fork()
     if (!child) {
         return -1;
     }
+    // 子进程处于USED状态, 调度器不会选中它
+    // 复制内存时可能因换出页面而睡眠, 不能持有自旋锁
+    spinlock_release(&child->lk);
 
-    // 复制父进程的用户内存到子进程
-    uvm_copy_pgtbl(curr->pgtbl, child->pgtbl, curr->heap_top, curr->ustack_pages, curr->mmap);
-    child->heap_top = curr->heap_top;
+    // 复制父进程的用户内存到子进程(同一进程的其他线程此时不能改动页表结构)
+    mm_lock(curr->mm);
+    uvm_copy_pgtbl(curr->pgtbl, child->pgtbl, curr->mm->heap_top, curr->mm->ustack_pages, curr->mm->mmap);
+    child->mm->heap_top = curr->mm->heap_top;
+    child->mm->ustack_pages = curr->mm->ustack_pages;
+    mm_unlock(curr->mm);
 
-    // 复制父进程的 trapframe
+    // 复制父进程的 trapframe 和浮点状态(先把寄存器里还没保存的写回)
     memcpy(child->tf, curr->tf, sizeof(trapframe_t));
+    fpu_flush(curr);
+    child->fpu_used = curr->fpu_used;
+    child->fpu = curr->fpu;
 
     // 子进程的返回值为 0
     child->tf->a0 = 0;
 
     // 复制打开的文件描述符
-    for (int i = 0; i < FILE_PER_PROC; i++) {
-        if (curr->filelist[i] != NULL) {
-            child->filelist[i] = file_dup(curr->filelist[i]);
-        }
-    }
+    fdtable_copy(child->files, curr->files);
 
     // TODO: 复制进程名
     // safestrcpy(child->name, curr->name, sizeof(curr->name));
 
     pid = child->pid;
 
-    spinlock_release(&child->lk);
-
     // 在等待锁保护下设置父子关系
-    // TODO: 实现wait_lock机制
-    // acquire(&wait_lock);
-    child->parent = curr;
-    // release(&wait_lock);
+    proc_set_parent(child, curr);
 
-    // 设置子进程为可运行状态
+    // 设置子进程为可运行状态, 放到负载最轻的CPU上
+    // 子进程继承父进程的nice和亲和性, 从nice允许的最高层开始
     spinlock_acquire(&child->lk);
-    child->state = RUNNABLE;
+    child->nice = curr->nice;
+    child->prio = child->nice;
+    child->cpumask = curr->cpumask;
+    proc_reset_time_slice(child);
+    sched_ready(child, sched_pick_cpu(child));
     spinlock_release(&child->lk);
 
     return pid;
 }
 
+/*
+    创建一个与当前进程共享地址空间和文件描述符表的线程(相当于Linux的clone(CLONE_VM | CLONE_FILES))
+    新线程有自己的pid、内核栈和trapframe, 从clone返回处开始执行, 返回值为0, 用户栈指针为stack
+    用户栈由调用者事先在共享的地址空间中准备好; 线程退出后由创建者通过wait回收
+    成功返回新线程的pid, 失败返回-1
+*/
+int proc_clone(uint64 stack)
+{
+    proc_t* curr = myproc();
+    proc_t* t = proc_slot_alloc();
+    if (t == NULL)
+        return -1;
+    // 线程处于USED状态, 调度器不会选中它
+    // 映射trapframe要持有mm的睡眠锁, 不能持有自旋锁
+    spinlock_release(&t->lk);
+
+    if ((t->tf = (trapframe_t*)pmem_alloc(true)) == NULL) {
+        spinlock_acquire(&t->lk);
+        proc_free(t);
+        spinlock_release(&t->lk);
+        proc_discard(t);
+        return -1;
+    }
+    t->mm = mm_get(curr->mm);
+    t->pgtbl = curr->pgtbl;
+    t->files = fdtable_get(curr->files);
+
+    // 每个线程的trapframe映射在共享页表中自己的槽位上(借用内核栈的槽号), trampoline按tf_va保存和恢复寄存器
+    t->tf_va = THREAD_TF(kstack_slot(t->kstack));
+    mm_lock(t->mm);
+    vm_mappages(t->pgtbl, t->tf_va, (uint64)t->tf, PGSIZE, PTE_R | PTE_W);
+    mm_unlock(t->mm);
+
+    // 从clone返回处继续执行, 返回值为0, 使用调用者给出的用户栈
+    memcpy(t->tf, curr->tf, sizeof(trapframe_t));
+    t->tf->a0 = 0;
+    t->tf->sp = stack;
+    fpu_flush(curr);
+    t->fpu_used = curr->fpu_used;
+    t->fpu = curr->fpu;
+    t->ctx.ra = (uint64)fork_return;
+
+    proc_set_parent(t, curr);
+    spinlock_acquire(&t->lk);
+    t->nice = curr->nice;
+    t->prio = t->nice;
+    t->cpumask = curr->cpumask;
+    proc_reset_time_slice(t);
+    int tid = t->pid;
+    sched_ready(t, sched_pick_cpu(t));
+    spinlock_release(&t->lk);
+
+    return tid;
+}
+
 // 进程放弃CPU的控制权 - 基于xv6的yield实现
 void proc_yield()
 {
     proc_t* p = myproc();
     spinlock_acquire(&p->lk);
-    p->state = RUNNABLE;
+    sched_ready(p, mycpuid());
     proc_sched();
     spinlock_release(&p->lk);
 }
 
-// 等待一个子进程进入 ZOMBIE 状态 - 基于xv6的kwait实现
-int proc_wait(uint64 addr)
+/*
+    等待一个子进程进入 ZOMBIE 状态 - 基于xv6的kwait实现
+    pid > 0时只等待这个子进程, 否则等待任意一个子进程
+    options包含WNOHANG时没有已退出的子进程就立即返回0
+    返回回收的子进程pid; 没有符合条件的子进程返回-1
+    只遍历自己的子进程链表, 代价与子进程数成正比
+*/
+int proc_wait(int pid, uint64 addr, int options)
 {
-    proc_t* pp;
-    int havekids, pid;
     proc_t* curr = myproc();
 
-
+    spinlock_acquire(&wait_lk);
     for (;;) {
-        // 扫描进程表查找已退出的子进程
-        havekids = 0;
-        for (pp = procs; pp < &procs[NPROC]; pp++) {
-            if (pp->parent == curr) {
-                // 确保子进程不再处于exit()或swtch()中
-                spinlock_acquire(&pp->lk);
-
-                havekids = 1;
-                if (pp->state == ZOMBIE) {
-                    // 找到一个已退出的子进程
-                    pid = pp->pid;
-                    if (addr != 0) {
-                        uvm_copyout(curr->pgtbl, addr, (uint64)&pp->exit_state,
-                                                sizeof(pp->exit_state));
-                    }
-                    proc_free(pp);
-                    spinlock_release(&pp->lk);
-                    // TODO: release(&wait_lock);
-                    return pid;
-                }
+        bool havekids = false;
+        proc_t* prev = NULL;
+        for (proc_t* pp = curr->children; pp != NULL; prev = pp, pp = pp->sibling) {
+            if (pid > 0 && pp->pid != pid)
+                continue;
+            // 确保子进程不再处于exit()或swtch()中
+            spinlock_acquire(&pp->lk);
+
+            // 内核线程挂在第一个进程名下只是为了退出后被回收, 不算作需要等待的子进程
+            if (pid > 0 || pp->kfn == NULL)
+                havekids = true;
+            if (pp->state == ZOMBIE) {
+                // 找到一个已退出的子进程, 从子进程链表中摘除后释放
+                int cpid = pp->pid;
+                int state = pp->exit_state;
+                if (prev != NULL)
+                    prev->sibling = pp->sibling;
+                else
+                    curr->children = pp->sibling;
+                proc_free(pp);
                 spinlock_release(&pp->lk);
+                spinlock_release(&wait_lk);
+                proc_discard(pp);
+                // 写回用户内存可能睡眠(换入页面), 放到锁外
+                if (addr != 0)
+                    uvm_copyout(curr->pgtbl, addr, (uint64)&state, sizeof(state));
+                return cpid;
             }
+            spinlock_release(&pp->lk);
         }
 
-
         if (!havekids) {
+            spinlock_release(&wait_lk);
             return -1;
         }
+        if (options & WNOHANG) {
+            spinlock_release(&wait_lk);
+            return 0;
+        }
 
-
-        proc_sleep(curr,NULL);
+        // 子进程退出时只唤醒自己的父进程(见proc_exit)
+        proc_sleep(curr, &wait_lk);
     }
 }
 
-
+// 把parent的子进程整体转交给第一个进程(持有wait_lk)
+// 转交过来的子进程里已经有退出的时才唤醒第一个进程
 static void proc_reparent(proc_t* parent)
 {
-    proc_t* pp;
-
-    for (pp = procs; pp < &procs[NPROC]; pp++) {
-        if (pp->parent == parent) {
-            pp->parent = proczero;
-            proc_wakeup(proczero);
-        }
-    }
-}
-
-// 唤醒一个进程
-static void __attribute__((unused)) proc_wakeup_one(proc_t* p)
-{
-    assert(spinlock_holding(&p->lk), "proc_wakeup_one: lock");
-    if(p->state == SLEEPING && p->sleep_space == p) {
-        p->state = RUNNABLE;
+    proc_t* pp = parent->children;
+    if (pp == NULL)
+        return;
+
+    bool zombie = false;
+    proc_t* last = NULL;
+    for (; pp != NULL; last = pp, pp = pp->sibling) {
+        pp->parent = proczero;
+        // 子进程的状态变成ZOMBIE时持有wait_lk, 这里读到的状态是确定的
+        if (pp->state == ZOMBIE)
+            zombie = true;
     }
+    last->sibling = proczero->children;
+    proczero->children = parent->children;
+    parent->children = NULL;
+    if (zombie)
+        proc_wakeup(proczero);
 }
 
-
 void proc_exit(int exit_state)
 {
     proc_t* curr = myproc();
@@ -449,7 +651,7 @@ void proc_exit(int exit_state)
     if (curr == proczero)
         panic("init exiting");
 
-
+    spinlock_acquire(&wait_lk);
 
     // 将所有子进程转交给init进程
     proc_reparent(curr);
@@ -459,10 +661,13 @@ void proc_exit(int exit_state)
 
     spinlock_acquire(&curr->lk);
 
+    // 归还截止期调度占用的带宽
+    sched_setdeadline(curr, 0, 0, 0);
     curr->exit_state = exit_state;
     curr->state = ZOMBIE;
 
-    // TODO: release(&wait_lock);
+    // 父进程拿到wait_lk之后看到的一定是ZOMBIE
+    spinlock_release(&wait_lk);
 
     // 跳转到调度器，永不返回
     proc_sched();
@@ -470,6 +675,12 @@ void proc_exit(int exit_state)
 }
 
 
+/*
+    让出CPU: 调用者持有p->lk, 并且已经改变了p->state
+    本hart或其他hart的队列里有能立即锁住的进程时直接切换过去, 不经过调度器循环
+    (一次上下文切换而不是两次); 只有没有进程可运行时才切换到调度器循环
+    切换离开的进程在切换到的一方调用proc_switch_finish之前一直保持锁住
+*/
 void proc_sched()
 {
     int intena;
@@ -484,9 +695,154 @@ void proc_sched()
     if (intr_get())
         panic("sched interruptible");
 
-    intena = mycpu()->intena;
-    swtch(&p->ctx, &mycpu()->ctx);
-    mycpu()->intena = intena;
+    // 浮点寄存器被改写过时保存下来, 进程可能在另一个hart上恢复运行
+    fpu_switch_out(p);
+
+    // 进程可能在另一个CPU上恢复运行, 关中断前的状态跟随进程而不是CPU
+    intena = mycpu()->origin;
+    proc_t* next = sched_next_locked();
+    if (next == p) {
+        // 让出CPU之后没有别的进程可以运行: 继续运行, 不必切换
+        p->state = RUNNING;
+    } else {
+        cpu_t* c = mycpu();
+        c->prev = p;
+        sched_stat_out(p, next != NULL);
+        if (next != NULL) {
+            sched_stat_in(next);
+            next->state = RUNNING;
+            c->proc = next;
+            // 内核栈槽可能已被释放后重新映射, 丢弃本CPU上残留的旧映射
+            sfence_vma();
+            swtch(&p->ctx, &next->ctx);
+        } else {
+            swtch(&p->ctx, &c->ctx);
+        }
+        proc_switch_finish();
+    }
+    mycpu()->origin = intena;
+}
+
+// 在切换到的上下文中调用(进程恢复运行处、新进程入口、调度器循环)
+// 切换离开的进程此时已经保存完上下文, 放开它的锁之后其他hart才可以运行或回收它
+void proc_switch_finish()
+{
+    sched_stat_done();
+    cpu_t* c = mycpu();
+    proc_t* prev = c->prev;
+    c->prev = NULL;
+    if (prev != NULL)
+        spinlock_release(&prev->lk);
+}
+
+// 采样一次所有地址空间的用户页表
+// 清除A/D位之后统一刷新一次TLB
+// 有线程正在其他CPU上运行时它可能同时修改页表, 由它返回用户态之前补做采样
+static void wss_sample_all()
+{
+    for (mm_t* mm = mm_next(NULL); mm != NULL; mm = mm_next(mm)) {
+        proc_t* owner = proc_pin(mm->pgtbl);
+        if (owner == NULL) {
+            mm->wss_pending = true;
+            continue;
+        }
+        wss_sample(mm->pgtbl, &mm->wss);
+        proc_unpin(owner);
+    }
+    sfence_vma();
+}
+
+// 工作集采样的内核线程: 每WSS_INTERVAL个tick采样一次
+void proc_wss_daemon(void* arg)
+{
+    for (;;) {
+        wss_sample_all();
+        twheel_sleep(WSS_INTERVAL);
+    }
+}
+
+// 找到pid对应的进程并持有它的锁, pid为0表示当前进程, 不存在返回NULL
+static proc_t* proc_lock_pid(int pid)
+{
+    if (pid == 0) {
+        proc_t* p = myproc();
+        spinlock_acquire(&p->lk);
+        return p;
+    }
+    spinlock_acquire(&ptable_lk);
+    proc_t* p = pid_hash[(uint32)pid % PID_HASH];
+    while (p != NULL && p->pid != pid)
+        p = p->pid_next;
+    if (p != NULL)
+        spinlock_acquire(&p->lk);
+    spinlock_release(&ptable_lk);
+    // 已经被父进程回收, 正在等待摘出进程表
+    if (p != NULL && p->state == UNUSED) {
+        spinlock_release(&p->lk);
+        return NULL;
+    }
+    return p;
+}
+
+/*
+    找到以pgtbl为用户页表的所有线程并锁住它们, 在proc_unpin之前它们都不会在任何CPU上运行
+    后台扫描(同页合并、页面回收、内存规整)改写别的进程的PTE之前必须先固定它,
+    否则对方可能正在另一个CPU上修改同一张页表或者通过TLB访问旧的页面
+    当前进程自己总可以固定; 任何一个线程正在其他CPU上运行、正在创建或锁被占用时返回NULL
+    只尝试加锁, 调用者持有其他锁(如rmap_lk或者某个线程的p->lk)时也不会死锁
+    返回其中一个线程, 它的mm就是这张页表的地址空间; 被固定的线程经pin_next串在一起
+*/
+proc_t* proc_pin(pgtbl_t pgtbl)
+{
+    if (pgtbl == NULL || !spinlock_try_acquire(&ptable_lk))
+        return NULL;
+    proc_t* first = NULL;
+    for (proc_t* p = ptable_head; p != NULL; p = p->all_next) {
+        if (p->pgtbl != pgtbl)
+            continue;
+        if (spinlock_holding(&p->lk) || !spinlock_try_acquire(&p->lk))
+            goto fail;
+        if (p->pgtbl != pgtbl || !(p->state == RUNNABLE || p->state == SLEEPING
+                                   || p == myproc())) {
+            spinlock_release(&p->lk);
+            goto fail;
+        }
+        p->pin_next = first;
+        first = p;
+    }
+    spinlock_release(&ptable_lk);
+    return first;
+
+fail:
+    // 只放开这次锁住的线程
+    spinlock_release(&ptable_lk);
+    proc_unpin(first);
+    return NULL;
+}
+
+// 释放proc_pin锁住的所有线程
+void proc_unpin(proc_t* p)
+{
+    while (p != NULL) {
+        proc_t* next = p->pin_next;
+        spinlock_release(&p->lk);
+        p = next;
+    }
+}
+
+// 查询pid对应进程的工作集信息, 进程不存在返回-1
+int proc_wss(int pid, wss_t* wss)
+{
+    proc_t* p = proc_lock_pid(pid);
+    if (p == NULL)
+        return -1;
+    int ret = -1;
+    if (p->mm != NULL) {
+        *wss = p->mm->wss;
+        ret = 0;
+    }
+    spinlock_release(&p->lk);
+    return ret;
 }
 
 // 调度器 - 基于xv6的scheduler实现 + 时间片轮转
@@ -494,8 +850,8 @@ void proc_scheduler()
 {
     proc_t* p;
     cpu_t* c = mycpu();
-    static int last_scheduled = -1;  // 记录上次调度的进程索引，用于轮转
     c->proc = NULL;
+    sched_online();
     for (;;) {
         // 最近运行的进程可能关闭了中断；启用中断以避免
         // 所有进程都在等待时的死锁。然后再关闭中断
@@ -503,42 +859,40 @@ void proc_scheduler()
         intr_on();
         intr_off();
 
-        int found = 0;
-
-        // 轮转调度：从上次调度的下一个进程开始寻找
-        int start_idx = (last_scheduled + 1) % NPROC;
-
-        for (int i = 0; i < NPROC; i++) {
-            int idx = (start_idx + i) % NPROC;
-            p = &procs[idx];
-
-            spinlock_acquire(&p->lk);
-            if (p->state == RUNNABLE) {
-                // 切换到选中的进程。进程的工作是
-                // 释放其锁然后重新获取它
-                // 在跳回到我们之前。
-                p->state = RUNNING;
-                c->proc = p;
-                last_scheduled = idx;  // 更新上次调度的进程索引
-
-                // 重置进程的时间片
-                proc_reset_time_slice(p);
-
-                swtch(&c->ctx, &p->ctx);
-
-                // 进程现在运行完毕。
-                // 它应该在回来之前改变其p->state。
-                c->proc = NULL;
-                found = 1;
-                spinlock_release(&p->lk);
-                break;  // 找到一个进程后立即退出循环
-            }
-            spinlock_release(&p->lk);
+        // 从本CPU的运行队列取进程, 队列为空时从其他CPU窃取
+        p = sched_next();
+        if (p == NULL) {
+            // 没有任何可运行的进程；停掉周期时钟，停止在这个核心上运行直到中断。
+            sched_idle();
+            continue;
         }
 
-        if (found == 0) {
-            // 没有任何可运行的进程；停止在这个核心上运行直到中断。
-            asm volatile("wfi");
+        // 进程让出CPU时一直持有p->lk直到切换完成, 这里拿到锁时它已经不在任何CPU上运行
+        spinlock_acquire(&p->lk);
+        // 出队之后、拿到锁之前亲和性被改掉了: 放回允许的hart
+        if (p->state == RUNNABLE && !CPU_ALLOWED(p, mycpuid())) {
+            sched_ready(p, sched_pick_cpu(p));
+            spinlock_release(&p->lk);
+        } else if (p->state == RUNNABLE) {
+            // 切换到选中的进程。进程的工作是
+            // 释放其锁然后重新获取它
+            // 在跳回到我们之前。
+            // 时间片沿用上次剩下的, 只在升降级时重置(见sched.h)
+            sched_stat_in(p);
+            p->state = RUNNING;
+            c->proc = p;
+
+            // 内核栈槽可能已被释放后重新映射, 丢弃本CPU上残留的旧映射
+            sfence_vma();
+            swtch(&c->ctx, &p->ctx);
+
+            // 进程现在运行完毕。
+            // 它应该在回来之前改变其p->state。
+            // 回到调度器的不一定是p(p可能已经直接切换给了别的进程), 由proc_switch_finish放开它的锁
+            c->proc = NULL;
+            proc_switch_finish();
+        } else {
+            spinlock_release(&p->lk);
         }
     }
 }
@@ -547,17 +901,29 @@ void proc_scheduler()
 void proc_sleep(void* chan,spinlock_t* x)
 {
     proc_t* p = myproc();
+    sleepq_t* q = sleepq_of(chan);
 
+    // 先挂进睡眠队列并拿到p->lk再释放条件锁: 其他CPU上的唤醒者要等我们切换离开才能检查状态
+    // 否则在两者之间发生的唤醒会丢失
+    spinlock_acquire(&q->lk);
+    spinlock_acquire(&p->lk);
     if(x!=NULL)
     spinlock_release(x);
-    spinlock_acquire(&p->lk);
-
-    // 进入睡眠
     p->sleep_space = chan;
+    p->sleep_next = NULL;
+    if (q->tail != NULL)
+        q->tail->sleep_next = p;
+    else
+        q->head = p;
+    q->tail = p;
+    spinlock_release(&q->lk);
+
+    // 进入睡眠(主动睡眠的交互型进程可能升一级)
+    sched_promote(p);
     p->state = SLEEPING;
     proc_sched();
 
-    // 整理
+    // 整理(唤醒者已经把我们从睡眠队列中摘除)
     p->sleep_space = NULL;
 
     // 重新获取原始锁
@@ -566,29 +932,172 @@ void proc_sleep(void* chan,spinlock_t* x)
     spinlock_acquire(x);
 }
 
-// 唤醒所有在channel上睡眠的进程 - 基于xv6的wakeup实现
+// 唤醒chan上的等待者, one为true时只唤醒最早睡眠的一个
+static void sleepq_wakeup(void* chan, bool one)
+{
+    sleepq_t* q = sleepq_of(chan);
+    proc_t* prev = NULL;
+
+    spinlock_acquire(&q->lk);
+    proc_t* p = q->head;
+    while (p != NULL) {
+        proc_t* next = p->sleep_next;
+        if (p->sleep_space != chan) {
+            prev = p;
+            p = next;
+            continue;
+        }
+        // 从队列中摘除
+        if (prev != NULL)
+            prev->sleep_next = next;
+        else
+            q->head = next;
+        if (q->tail == p)
+            q->tail = prev;
+        p->sleep_next = NULL;
+
+        // 睡眠者切换离开之后才会释放p->lk
+        spinlock_acquire(&p->lk);
+        assert(p->state == SLEEPING, "sleepq_wakeup: state");
+        // 放到当前CPU或负载最轻的CPU上
+        sched_ready(p, sched_pick_cpu(p));
+        spinlock_release(&p->lk);
+        if (one)
+            break;
+        p = next;
+    }
+    spinlock_release(&q->lk);
+}
+
+// 唤醒所有在channel上睡眠的进程
 // 调用者应该持有条件锁
 void proc_wakeup(void* chan)
 {
-    proc_t* p;
+    sleepq_wakeup(chan, false);
+}
 
-    for (p = procs; p < &procs[NPROC]; p++) {
-        if (p != myproc()) {
-            spinlock_acquire(&p->lk);
-            if (p->state == SLEEPING && p->sleep_space == chan) {
-                p->state = RUNNABLE;
-            }
-            spinlock_release(&p->lk);
-        }
-    }
+// 排他唤醒: 只唤醒channel上等得最久的一个进程
+// 用于一次只够一个等待者使用的资源, 避免所有等待者一起醒来再争抢(惊群)
+// 被唤醒者拿到资源后如果还有剩余, 应当再调用一次把唤醒传给下一个等待者
+void proc_wakeup_one(void* chan)
+{
+    sleepq_wakeup(chan, true);
 }
 
 // 时间片相关函数
 
-// 重置进程的时间片（用于新调度的进程）
+// 重置进程的时间片（长度由所在的优先级层决定）
 void proc_reset_time_slice(proc_t* p)
 {
     if (p) {
-        p->time_slice = TIME_SLICE;
+        p->time_slice = MLFQ_QUANTUM(p->prio);
+    }
+}
+
+// 周期性优先级提升(CPU 0每MLFQ_BOOST个tick调用一次)
+// 所有进程回到nice允许的最高层并获得新的时间片, 然后重新整理运行队列
+void proc_boost()
+{
+    spinlock_acquire(&ptable_lk);
+    for (proc_t* p = ptable_head; p != NULL; p = p->all_next) {
+        spinlock_acquire(&p->lk);
+        if (p->state != UNUSED) {
+            p->prio = p->nice;
+            proc_reset_time_slice(p);
+        }
+        spinlock_release(&p->lk);
+    }
+    spinlock_release(&ptable_lk);
+    sched_requeue();
+}
+
+// 调整当前进程的nice值, 结果限制在[0, MLFQ_LEVELS-1], 返回调整后的nice
+// nice是进程能进入的最高优先级层: 调大时立即降到该层, 调小时等待睡眠升级或周期性提升
+int proc_nice(int inc)
+{
+    proc_t* p = myproc();
+    spinlock_acquire(&p->lk);
+    int nice = p->nice + inc;
+    if (nice < 0)
+        nice = 0;
+    if (nice > MLFQ_LEVELS - 1)
+        nice = MLFQ_LEVELS - 1;
+    p->nice = nice;
+    if (p->prio < nice) {
+        p->prio = nice;
+        proc_reset_time_slice(p);
+    }
+    spinlock_release(&p->lk);
+    return nice;
+}
+// 设置进程允许运行的hart, pid为0表示当前进程
+// mask中还没有上线的hart被忽略, 剩下的为空时失败; 成功返回0 失败返回-1
+// 截止期进程固定在准入时分配的hart上, 不能修改亲和性
+// 排队中的进程立即转到允许的hart; 正在其他hart上运行的进程在下一次时钟中断时离开
+int proc_setaffinity(int pid, uint64 mask)
+{
+    mask &= sched_online_mask();
+    if (mask == 0)
+        return -1;
+    proc_t* p = proc_lock_pid(pid);
+    if (p == NULL)
+        return -1;
+    if (p->dl_runtime > 0) {
+        spinlock_release(&p->lk);
+        return -1;
+    }
+
+    p->cpumask = mask;
+    bool leave = false;
+    if (p->state == RUNNABLE && !CPU_ALLOWED(p, p->cpu)) {
+        // 已被调度器取走时由调度器负责放回(见proc_scheduler)
+        if (sched_dequeue(p))
+            sched_ready(p, sched_pick_cpu(p));
+    } else if (p == myproc() && !CPU_ALLOWED(p, mycpuid())) {
+        leave = true;
     }
-}
\ No newline at end of file
+    spinlock_release(&p->lk);
+
+    // 当前进程不再允许在这个hart上运行: 马上让出CPU, sched_ready会把它放到允许的hart
+    if (leave)
+        proc_yield();
+    return 0;
+}
+
+// 查询进程允许运行的hart, pid为0表示当前进程; 成功返回0 失败返回-1
+int proc_getaffinity(int pid, uint64* mask)
+{
+    proc_t* p = proc_lock_pid(pid);
+    if (p == NULL)
+        return -1;
+    *mask = p->cpumask;
+    spinlock_release(&p->lk);
+    return 0;
+}
+
+// 当前进程加入截止期调度(参数见sched_setdeadline, 单位是tick), runtime为0时回到普通进程
+// 成功返回0, 参数不合法或者没有hart放得下它的带宽时返回-1
+int proc_setdeadline(uint64 runtime, uint64 deadline, uint64 period)
+{
+    proc_t* p = myproc();
+    spinlock_acquire(&p->lk);
+    int ret = sched_setdeadline(p, runtime, deadline, period);
+    bool leave = ret == 0 && p->dl_runtime > 0 && p->dl_cpu != mycpuid();
+    spinlock_release(&p->lk);
+
+    // 分配到了别的hart: 让出CPU, sched_ready会把它放到那里
+    if (leave)
+        proc_yield();
+    return ret;
+}
+
+// 查询进程的调度统计, pid为0表示当前进程; 进程不存在返回-1
+int proc_schedstat(int pid, proc_schedstat_t* st)
+{
+    proc_t* p = proc_lock_pid(pid);
+    if (p == NULL)
+        return -1;
+    *st = p->stat;
+    spinlock_release(&p->lk);
+    return 0;
+}
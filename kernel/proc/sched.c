@@ -0,0 +1,655 @@
+#include "proc/sched.h"
+#include "proc/cpu.h"
+#include "dev/timer.h"
+#include "dev/twheel.h"
+#include "lib/print.h"
+#include "riscv.h"
+
+// 所有hart的运行队列初始化(在proc_init中调用)
+void sched_init()
+{
+    for (int i = 0; i < NCPU; i++) {
+        cpu_t* c = cpu_get(i);
+        spinlock_init(&c->rq_lk, "rq");
+        for (int l = 0; l < MLFQ_LEVELS; l++) {
+            c->rq_head[l] = NULL;
+            c->rq_tail[l] = NULL;
+        }
+        c->dl_head = NULL;
+        c->dl_bw = 0;
+        c->rq_len = 0;
+        c->load_avg = 0;
+        c->balance_last = 0;
+    }
+}
+
+// 当前hart进入调度器, 之后其他hart才会把进程放到这里或从这里窃取
+void sched_online()
+{
+    __atomic_store_n(&mycpu()->online, true, __ATOMIC_RELEASE);
+}
+
+static int rq_len(cpu_t* c)
+{
+    return __atomic_load_n(&c->rq_len, __ATOMIC_RELAXED);
+}
+
+// c的队列中最高的非空层, 全空返回MLFQ_LEVELS (不加锁, 只作参考)
+static int rq_top(cpu_t* c)
+{
+    for (int l = 0; l < MLFQ_LEVELS; l++) {
+        if (__atomic_load_n(&c->rq_head[l], __ATOMIC_RELAXED) != NULL)
+            return l;
+    }
+    return MLFQ_LEVELS;
+}
+
+// 负载: 排队的进程数, 正在运行进程时再加一
+static int cpu_load(cpu_t* c)
+{
+    return rq_len(c) + (__atomic_load_n(&c->proc, __ATOMIC_RELAXED) != NULL);
+}
+
+static bool cpu_online(cpu_t* c)
+{
+    return __atomic_load_n(&c->online, __ATOMIC_ACQUIRE);
+}
+
+uint64 sched_online_mask()
+{
+    uint64 mask = 0;
+    for (int i = 0; i < NCPU; i++) {
+        if (cpu_online(cpu_get(i)))
+            mask |= 1ul << i;
+    }
+    return mask;
+}
+
+static bool cpu_idle(cpu_t* c)
+{
+    return __atomic_load_n(&c->idle, __ATOMIC_SEQ_CST);
+}
+
+// p刚加入cpuid的队列: 必要时叫醒一个空闲的hart
+static void sched_kick(int cpuid, proc_t* p)
+{
+    cpu_t* c = cpu_get(cpuid);
+    // 与sched_idle配对: 要么这里看到idle, 要么对方置位idle之后看到队列里的p
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (cpu_idle(c)) {
+        ipi_send(cpuid);
+        return;
+    }
+    // 目标hart很快就会运行p(让出CPU的进程回到自己的队列)时不必惊动别人
+    proc_t* cur = __atomic_load_n(&c->proc, __ATOMIC_RELAXED);
+    if (rq_len(c) < 2 && (cur == NULL || cur == p))
+        return;
+    for (int i = 0; i < NCPU; i++) {
+        cpu_t* o = cpu_get(i);
+        if (i != cpuid && cpu_online(o) && CPU_ALLOWED(p, i) && cpu_idle(o)) {
+            ipi_send(i);
+            return;
+        }
+    }
+}
+
+// 把p接到c的第level层队尾(持有c->rq_lk)
+static void rq_append(cpu_t* c, int level, proc_t* p)
+{
+    p->rq_next = NULL;
+    if (c->rq_tail[level] != NULL)
+        c->rq_tail[level]->rq_next = p;
+    else
+        c->rq_head[level] = p;
+    c->rq_tail[level] = p;
+}
+
+// 把p从c的第level层摘下, prev是它在链表中的前一个进程(持有c->rq_lk)
+static void rq_unlink(cpu_t* c, int level, proc_t* p, proc_t* prev)
+{
+    if (prev != NULL)
+        prev->rq_next = p->rq_next;
+    else
+        c->rq_head[level] = p->rq_next;
+    if (c->rq_tail[level] == p)
+        c->rq_tail[level] = prev;
+    p->rq_next = NULL;
+    c->rq_len--;
+}
+
+// 截止期进程开始一个新的周期
+static void dl_replenish(proc_t* p, uint64 now)
+{
+    p->dl_release = now;
+    p->dl_abs = now + p->dl_deadline;
+    p->dl_left = p->dl_runtime;
+}
+
+// 节流结束(时间轮回调, CPU 0的时钟中断中执行): 补充预算并放回所属hart的队列
+static void dl_unthrottle(void* arg)
+{
+    proc_t* p = arg;
+    spinlock_acquire(&p->lk);
+    if (p->dl_throttled) {
+        p->dl_throttled = false;
+        dl_replenish(p, timer_get_ticks());
+        sched_ready(p, p->dl_cpu);
+    }
+    spinlock_release(&p->lk);
+}
+
+// 按绝对截止期把p插入c的截止期队列, 截止期相同时排在后面(持有c->rq_lk)
+static void dl_insert(cpu_t* c, proc_t* p)
+{
+    proc_t** pp = &c->dl_head;
+    while (*pp != NULL && (*pp)->dl_abs <= p->dl_abs)
+        pp = &(*pp)->rq_next;
+    p->rq_next = *pp;
+    *pp = p;
+}
+
+void sched_ready(proc_t* p, int cpuid)
+{
+    assert(spinlock_holding(&p->lk), "sched_ready: lock");
+    p->state = RUNNABLE;
+
+    if (p->dl_runtime > 0) {
+        // 截止期进程只在准入时分配的hart上运行
+        cpuid = p->dl_cpu;
+        uint64 now = timer_get_ticks();
+        uint64 next = p->dl_release + p->dl_period;
+        // 只有上一个周期结束后才开始新的周期; 截止期已过而周期未结束时继续用剩余的预算
+        if (now >= next)
+            dl_replenish(p, now);
+        if (p->dl_left == 0) {
+            // 本周期的预算用完: 等到下一个周期开始
+            p->dl_throttled = true;
+            p->cpu = cpuid;
+            twheel_add(&p->dl_timer, next);
+            return;
+        }
+    } else if (!CPU_ALLOWED(p, cpuid)) {
+        // 亲和性不允许时换到允许的hart上(如让出CPU的进程刚被改了亲和性)
+        cpuid = sched_pick_cpu(p);
+    }
+    cpu_t* c = cpu_get(cpuid);
+
+    p->cpu = cpuid;
+    p->stat_enqueued = r_time();
+    spinlock_acquire(&c->rq_lk);
+    if (p->dl_runtime > 0)
+        dl_insert(c, p);
+    else
+        rq_append(c, p->prio, p);
+    c->rq_len++;
+    spinlock_release(&c->rq_lk);
+    sched_kick(cpuid, p);
+}
+
+// 负载均衡只持有rq_lk就会改变排队进程的p->cpu, 没找到时确认p->cpu没变再下结论
+bool sched_dequeue(proc_t* p)
+{
+    assert(spinlock_holding(&p->lk), "sched_dequeue: lock");
+    for (;;) {
+        int cpuid = __atomic_load_n(&p->cpu, __ATOMIC_RELAXED);
+        cpu_t* c = cpu_get(cpuid);
+        spinlock_acquire(&c->rq_lk);
+        for (proc_t** pp = &c->dl_head; *pp != NULL; pp = &(*pp)->rq_next) {
+            if (*pp == p) {
+                *pp = p->rq_next;
+                p->rq_next = NULL;
+                c->rq_len--;
+                spinlock_release(&c->rq_lk);
+                return true;
+            }
+        }
+        // 优先级提升期间p->prio可能与所在的层不一致, 逐层查找
+        for (int l = 0; l < MLFQ_LEVELS; l++) {
+            proc_t* prev = NULL;
+            for (proc_t* q = c->rq_head[l]; q != NULL; prev = q, q = q->rq_next) {
+                if (q == p) {
+                    rq_unlink(c, l, p, prev);
+                    spinlock_release(&c->rq_lk);
+                    return true;
+                }
+            }
+        }
+        bool moved = p->cpu != cpuid;
+        spinlock_release(&c->rq_lk);
+        if (!moved)
+            return false;
+    }
+}
+
+// 在p允许的hart中按负载比较, 正在运行进程的hart比同样队列长度的空闲hart更忙
+// 允许的hart都还没有上线时选其中编号最小的, 它上线后就会运行p
+int sched_pick_cpu(proc_t* p)
+{
+    int best = mycpuid();
+    cpu_t* self = cpu_get(best);
+    int best_load = (cpu_online(self) && CPU_ALLOWED(p, best)) ? cpu_load(self) : 0x7fffffff;
+    for (int i = 0; i < NCPU; i++) {
+        cpu_t* c = cpu_get(i);
+        if (!cpu_online(c) || !CPU_ALLOWED(p, i))
+            continue;
+        if (cpu_load(c) < best_load) {
+            best = i;
+            best_load = cpu_load(c);
+        }
+    }
+    if (!CPU_ALLOWED(p, best))
+        best = __builtin_ctzl(p->cpumask);
+    return best;
+}
+
+// 进程在队列中时尝试锁住它; 让出CPU的当前进程已经持有自己的锁
+static bool rq_trylock(proc_t* p)
+{
+    return spinlock_holding(&p->lk) || spinlock_try_acquire(&p->lk);
+}
+
+// 从c最高的非空层中取出第一个允许在hart cpuid上运行的进程
+// 截止期进程排在所有层之前, 但只能由所属的hart取走
+// locked为true时跳过锁被占用的进程(还在其他hart上切换离开), 返回时持有它的锁
+static proc_t* rq_pop(cpu_t* c, int cpuid, bool locked)
+{
+    spinlock_acquire(&c->rq_lk);
+    proc_t* d = c->dl_head;
+    if (c == cpu_get(cpuid) && d != NULL && (!locked || rq_trylock(d))) {
+        c->dl_head = d->rq_next;
+        d->rq_next = NULL;
+        c->rq_len--;
+        spinlock_release(&c->rq_lk);
+        return d;
+    }
+    for (int l = 0; l < MLFQ_LEVELS; l++) {
+        proc_t* prev = NULL;
+        for (proc_t* p = c->rq_head[l]; p != NULL; prev = p, p = p->rq_next) {
+            if (CPU_ALLOWED(p, cpuid) && (!locked || rq_trylock(p))) {
+                rq_unlink(c, l, p, prev);
+                p->cpu = cpuid;
+                spinlock_release(&c->rq_lk);
+                return p;
+            }
+        }
+    }
+    spinlock_release(&c->rq_lk);
+    return NULL;
+}
+
+static proc_t* sched_find(bool locked)
+{
+    cpu_t* self = mycpu();
+    int id = mycpuid();
+    if (rq_len(self) > 0) {
+        proc_t* p = rq_pop(self, id, locked);
+        if (p != NULL)
+            return p;
+    }
+
+    // 本hart空闲: 从最长的队列窃取(不加锁比较长度, 出队时再加锁确认)
+    cpu_t* victim = NULL;
+    int victim_len = 0;
+    for (int i = 0; i < NCPU; i++) {
+        cpu_t* c = cpu_get(i);
+        if (c == self || !cpu_online(c))
+            continue;
+        if (rq_len(c) > victim_len) {
+            victim = c;
+            victim_len = rq_len(c);
+        }
+    }
+    if (victim != NULL) {
+        proc_t* p = rq_pop(victim, id, locked);
+        if (p != NULL)
+            return p;
+    }
+    // 最长的队列里没有允许在本hart运行的进程, 依次尝试其他队列
+    for (int i = 0; i < NCPU; i++) {
+        cpu_t* c = cpu_get(i);
+        if (c == self || c == victim || !cpu_online(c) || rq_len(c) == 0)
+            continue;
+        proc_t* p = rq_pop(c, id, locked);
+        if (p != NULL)
+            return p;
+    }
+    return NULL;
+}
+
+proc_t* sched_next()
+{
+    return sched_find(false);
+}
+
+// 进程让出CPU时(持有自己的锁)直接挑选下一个进程
+// 可能返回当前进程自己: 它刚回到队列里而且没有别的进程可以运行
+proc_t* sched_next_locked()
+{
+    return sched_find(true);
+}
+
+// c的队列里是否有允许在hart id上运行的进程
+static bool rq_has_allowed(cpu_t* c, int id)
+{
+    bool found = false;
+    spinlock_acquire(&c->rq_lk);
+    if (c == cpu_get(id) && c->dl_head != NULL)
+        found = true;
+    for (int l = 0; l < MLFQ_LEVELS && !found; l++) {
+        for (proc_t* p = c->rq_head[l]; p != NULL && !found; p = p->rq_next)
+            found = CPU_ALLOWED(p, id);
+    }
+    spinlock_release(&c->rq_lk);
+    return found;
+}
+
+// 是否有任何可以运行或窃取的进程(亲和性不允许在本hart运行的不算)
+static bool work_available()
+{
+    int id = mycpuid();
+    for (int i = 0; i < NCPU; i++) {
+        cpu_t* c = cpu_get(i);
+        if (cpu_online(c) && rq_len(c) > 0 && rq_has_allowed(c, id))
+            return true;
+    }
+    return false;
+}
+
+// 调度器找不到进程时调用(关中断)
+// 停掉周期时钟后wfi, 直到处理器间中断或下一个定时事件到期; 醒来后恢复周期时钟
+// CPU 0还负责推进时间轮, 按最近的定时事件设置唤醒时间; 其他hart不设唤醒时间
+void sched_idle()
+{
+    cpu_t* self = mycpu();
+    int id = mycpuid();
+
+    __atomic_store_n(&self->idle, true, __ATOMIC_SEQ_CST);
+    // 置位之后再检查一次队列, 与sched_kick配对, 不会错过入队
+    if (!work_available()) {
+        // 空闲的时间不算作切换耗时
+        self->stat_switch = 0;
+        uint64 start = r_time();
+        timer_tick_stop(id == 0 ? twheel_idle() : TIMER_NEVER);
+        asm volatile("wfi");
+        timer_tick_start();
+        if (id == 0)
+            twheel_idle_end();
+        self->stat.idle_time += r_time() - start;
+    }
+    __atomic_store_n(&self->idle, false, __ATOMIC_SEQ_CST);
+}
+
+// 把最忙的hart上最多n个允许在self上运行的进程拉到self的队列, 从最低层开始拉
+// 两个rq_lk按hart编号顺序获取; 只改动队列, 不需要p->lk(入队出队都在rq_lk下完成)
+static void rq_pull(cpu_t* self, int id, cpu_t* busiest, int bid, int n)
+{
+    if (id < bid) {
+        spinlock_acquire(&self->rq_lk);
+        spinlock_acquire(&busiest->rq_lk);
+    } else {
+        spinlock_acquire(&busiest->rq_lk);
+        spinlock_acquire(&self->rq_lk);
+    }
+    for (int l = MLFQ_LEVELS - 1; l >= 0 && n > 0; l--) {
+        proc_t* prev = NULL;
+        proc_t* p = busiest->rq_head[l];
+        while (p != NULL && n > 0) {
+            proc_t* next = p->rq_next;
+            if (!CPU_ALLOWED(p, id)) {
+                prev = p;
+                p = next;
+                continue;
+            }
+            rq_unlink(busiest, l, p, prev);
+            rq_append(self, l, p);
+            self->rq_len++;
+            p->cpu = id;
+            n--;
+            p = next;
+        }
+    }
+    spinlock_release(&self->rq_lk);
+    spinlock_release(&busiest->rq_lk);
+}
+
+// 负载均衡: 找负载平均最高的hart, 比本hart多出一个进程以上时拉过来一半的差距
+static void sched_balance()
+{
+    cpu_t* self = mycpu();
+    int id = mycpuid();
+    int self_load = __atomic_load_n(&self->load_avg, __ATOMIC_RELAXED);
+
+    cpu_t* busiest = NULL;
+    int bid = -1;
+    int busiest_load = self_load;
+    for (int i = 0; i < NCPU; i++) {
+        cpu_t* c = cpu_get(i);
+        if (c == self || !cpu_online(c) || rq_len(c) == 0)
+            continue;
+        int load = __atomic_load_n(&c->load_avg, __ATOMIC_RELAXED);
+        if (load > busiest_load) {
+            busiest = c;
+            bid = i;
+            busiest_load = load;
+        }
+    }
+    if (busiest == NULL || busiest_load - self_load <= SCHED_LOAD_SCALE)
+        return;
+
+    int n = ((busiest_load - self_load) / 2) >> SCHED_LOAD_SHIFT;
+    if (n < 1)
+        n = 1;
+    if (n > rq_len(busiest))
+        n = rq_len(busiest);
+    rq_pull(self, id, busiest, bid, n);
+}
+
+// 时钟中断中调用(关中断)
+// 负载平均每个tick衰减1/4: 反映最近几个tick的负载, 又不会因为一瞬间的入队出队而抖动
+void sched_tick()
+{
+    cpu_t* self = mycpu();
+    self->stat.nr_ticks++;
+    int load = cpu_load(self) << SCHED_LOAD_SHIFT;
+    __atomic_store_n(&self->load_avg, (self->load_avg * 3 + load) / 4, __ATOMIC_RELAXED);
+
+    uint64 now = timer_get_ticks();
+    if (now - self->balance_last >= SCHED_BALANCE) {
+        self->balance_last = now;
+        sched_balance();
+    }
+}
+
+// 每次trap返回之前检查: 时间片用完(降一级并换上新一层的时间片),
+// 或者本hart的队列里有更高优先级的进程在等待时, 当前进程应当让出CPU
+bool sched_preempt(proc_t* p)
+{
+    assert(spinlock_holding(&p->lk), "sched_preempt: lock");
+    cpu_t* c = mycpu();
+    if (p->dl_runtime > 0) {
+        // 截止期进程不参与多级反馈: 预算用完时让出(由sched_ready节流), 有更早截止的进程时让出
+        if (p->dl_left == 0)
+            return true;
+        spinlock_acquire(&c->rq_lk);
+        bool earlier = c->dl_head != NULL && c->dl_head->dl_abs < p->dl_abs;
+        spinlock_release(&c->rq_lk);
+        return earlier;
+    }
+    // 截止期进程总是优先于普通进程
+    if (__atomic_load_n(&c->dl_head, __ATOMIC_RELAXED) != NULL)
+        return true;
+    if (p->time_slice == 0) {
+        if (p->prio < MLFQ_LEVELS - 1)
+            p->prio++;
+        proc_reset_time_slice(p);
+        return true;
+    }
+    // 亲和性被改掉之后尽快离开这个hart
+    return rq_top(c) < p->prio || !CPU_ALLOWED(p, mycpuid());
+}
+
+// 时间片还剩一半以上就睡眠的进程升一级(不高于nice), 换上新一层的时间片
+// 用掉大半个时间片才睡眠的进程保持原层和剩余时间片, 防止靠睡眠刷新时间片
+void sched_promote(proc_t* p)
+{
+    assert(spinlock_holding(&p->lk), "sched_promote: lock");
+    if (p->time_slice * 2 < MLFQ_QUANTUM(p->prio))
+        return;
+    if (p->prio > p->nice)
+        p->prio--;
+    proc_reset_time_slice(p);
+}
+
+// 优先级提升改写了队列中进程的p->prio, 把每个队列按新的优先级重新分层(保持原有顺序)
+void sched_requeue()
+{
+    for (int i = 0; i < NCPU; i++) {
+        cpu_t* c = cpu_get(i);
+        proc_t* head[MLFQ_LEVELS] = { NULL };
+        spinlock_acquire(&c->rq_lk);
+        for (int l = 0; l < MLFQ_LEVELS; l++) {
+            head[l] = c->rq_head[l];
+            c->rq_head[l] = NULL;
+            c->rq_tail[l] = NULL;
+        }
+        for (int l = 0; l < MLFQ_LEVELS; l++) {
+            proc_t* p = head[l];
+            while (p != NULL) {
+                proc_t* next = p->rq_next;
+                rq_append(c, p->prio, p);
+                p = next;
+            }
+        }
+        spinlock_release(&c->rq_lk);
+    }
+}
+
+// 从hart id的带宽中减去bw
+static void dl_bw_release(int id, uint64 bw)
+{
+    cpu_t* c = cpu_get(id);
+    spinlock_acquire(&c->rq_lk);
+    c->dl_bw -= bw;
+    spinlock_release(&c->rq_lk);
+}
+
+/*
+    当前进程加入截止期调度(runtime > 0)或回到普通进程(runtime == 0), 持有p->lk
+    deadline为0表示等于period, 要求 0 < runtime <= deadline <= period <= SCHED_DL_MAX
+    准入控制: 在p允许的已上线hart中(优先原来分配的hart和当前hart)找一个带宽放得下的,
+    找不到时拒绝并保持原来的参数; 成功返回0 失败返回-1
+    分配到的hart不是当前hart时由调用者让出CPU, 迁移过去
+*/
+int sched_setdeadline(proc_t* p, uint64 runtime, uint64 deadline, uint64 period)
+{
+    assert(spinlock_holding(&p->lk), "sched_setdeadline: lock");
+    if (runtime == 0 && p->dl_runtime == 0)
+        return 0;
+    if (deadline == 0)
+        deadline = period;
+    if (runtime > 0 && (period == 0 || period > SCHED_DL_MAX || runtime > deadline || deadline > period))
+        return -1;
+
+    int cpuid = -1;
+    uint64 bw = 0;
+    if (runtime > 0) {
+        // 向上取整: 再小的进程也占用带宽, 准入不会低估
+        bw = ((runtime << SCHED_DL_SHIFT) + deadline - 1) / deadline;
+        int first = p->dl_runtime > 0 ? p->dl_cpu : mycpuid();
+        for (int i = 0; i < NCPU && cpuid < 0; i++) {
+            int id = (first + i) % NCPU;
+            cpu_t* c = cpu_get(id);
+            if (!cpu_online(c) || !CPU_ALLOWED(p, id))
+                continue;
+            spinlock_acquire(&c->rq_lk);
+            // 在原来的hart上调整参数时先扣除自己原来的带宽
+            uint64 used = c->dl_bw;
+            if (p->dl_runtime > 0 && p->dl_cpu == id)
+                used -= p->dl_bw;
+            if (used + bw <= SCHED_DL_LIMIT) {
+                c->dl_bw = used + bw;
+                cpuid = id;
+            }
+            spinlock_release(&c->rq_lk);
+        }
+        if (cpuid < 0)
+            return -1;
+    }
+
+    // 归还原来hart上的带宽(在同一个hart上调整时上面已经扣除)
+    if (p->dl_runtime > 0 && p->dl_cpu != cpuid)
+        dl_bw_release(p->dl_cpu, p->dl_bw);
+
+    p->dl_runtime = runtime;
+    p->dl_deadline = deadline;
+    p->dl_period = period;
+    p->dl_bw = bw;
+    if (runtime > 0) {
+        p->dl_cpu = cpuid;
+        twheel_event_init(&p->dl_timer, dl_unthrottle, p);
+        dl_replenish(p, timer_get_ticks());
+    } else {
+        p->prio = p->nice;
+        proc_reset_time_slice(p);
+    }
+    return 0;
+}
+
+// log2直方图的桶号
+static int stat_bucket(uint64 t)
+{
+    int b = t == 0 ? 0 : 63 - __builtin_clzl(t);
+    return b < SCHEDSTAT_BUCKETS ? b : SCHEDSTAT_BUCKETS - 1;
+}
+
+// RUNNABLE状态离开算作非自愿(时间片用完、被抢占或迁移), 睡眠和退出算作自愿
+void sched_stat_out(proc_t* p, bool direct)
+{
+    cpu_t* c = mycpu();
+    uint64 now = r_time();
+    p->stat.run_time += now - p->stat_oncpu;
+    if (p->state == RUNNABLE)
+        p->stat.nr_involuntary++;
+    else
+        p->stat.nr_voluntary++;
+    c->stat.nr_switches++;
+    if (direct)
+        c->stat.nr_direct++;
+    c->stat_switch = now;
+}
+
+void sched_stat_in(proc_t* p)
+{
+    cpu_t* c = mycpu();
+    int id = mycpuid();
+    uint64 now = r_time();
+    uint64 wait = now - p->stat_enqueued;
+    p->stat.wait_time += wait;
+    if (wait > p->stat.wait_max)
+        p->stat.wait_max = wait;
+    p->stat.nr_runs++;
+    if (p->stat_last_cpu >= 0 && p->stat_last_cpu != id)
+        p->stat.nr_migrations++;
+    p->stat_last_cpu = id;
+    p->stat_oncpu = now;
+    c->stat.wait_hist[stat_bucket(wait)]++;
+}
+
+// 调度器循环里没有正在运行的进程, 切换只完成了一半, 不记录
+void sched_stat_done()
+{
+    cpu_t* c = mycpu();
+    if (c->proc == NULL || c->stat_switch == 0)
+        return;
+    c->stat.switch_hist[stat_bucket(r_time() - c->stat_switch)]++;
+    c->stat_switch = 0;
+}
+
+// 查询hart的调度统计, hart不存在或没有上线返回-1
+int sched_cpustat(int id, cpu_schedstat_t* st)
+{
+    if (id < 0 || id >= NCPU || !cpu_online(cpu_get(id)))
+        return -1;
+    *st = cpu_get(id)->stat;
+    return 0;
+}
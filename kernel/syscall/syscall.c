@@ -102,6 +102,48 @@ void syscall()
         case SYS_release_block: // 25号系统调用：释放buffer
             ret = sys_release_block();
             break;
+        case SYS_huge_count: // 26号系统调用：查询本进程的大页数量
+            ret = sys_huge_count();
+            break;
+        case SYS_zswap_stat: // 27号系统调用：查询压缩交换缓存的统计信息
+            ret = sys_zswap_stat();
+            break;
+        case SYS_ksm_stat: // 28号系统调用：查询同页合并的统计信息
+            ret = sys_ksm_stat();
+            break;
+        case SYS_wss: // 29号系统调用：查询进程的工作集大小
+            ret = sys_wss();
+            break;
+        case SYS_compact: // 30号系统调用：规整物理内存
+            ret = sys_compact();
+            break;
+        case SYS_mremap: // 31号系统调用：调整或搬迁一段映射
+            ret = sys_mremap();
+            break;
+        case SYS_nice: // 32号系统调用：调整进程的调度优先级
+            ret = sys_nice();
+            break;
+        case SYS_clone: // 33号系统调用：创建共享地址空间的线程
+            ret = sys_clone();
+            break;
+        case SYS_futex: // 34号系统调用：在用户态锁字上等待或唤醒
+            ret = sys_futex();
+            break;
+        case SYS_sched_setaffinity: // 35号系统调用：设置进程允许运行的CPU
+            ret = sys_sched_setaffinity();
+            break;
+        case SYS_sched_getaffinity: // 36号系统调用：查询进程允许运行的CPU
+            ret = sys_sched_getaffinity();
+            break;
+        case SYS_waitpid: // 37号系统调用：等待指定的子进程退出
+            ret = sys_waitpid();
+            break;
+        case SYS_sched_setdeadline: // 38号系统调用：设置截止期调度参数
+            ret = sys_sched_setdeadline();
+            break;
+        case SYS_sched_stats: // 39号系统调用：读取进程或hart的调度统计
+            ret = sys_sched_stats();
+            break;
         default:
             printf("unknown sys call %d\n", num);
             ret = -1;
@@ -19,12 +19,8 @@ static int arg_fd(int n, int* pfd, file_t** pfile)
     int fd = 0;
     arg_uint32(n, (uint32*)(&fd));
     
-    // fd 溢出
-    if(fd < 0 || fd >= FILE_PER_PROC)
-        return -1;
-    
-    // 确定fd对应的file
-    file_t* file = myproc()->filelist[fd];
+    // 确定fd对应的file (fd溢出时也返回NULL)
+    file_t* file = fdtable_lookup(myproc()->files, fd);
     if(file == NULL)
         return -1;
     
@@ -38,16 +34,7 @@ static int arg_fd(int n, int* pfd, file_t** pfile)
 // 失败返回-1
 static int fd_alloc(file_t* file)
 {
-    proc_t* p = myproc();
-
-    for(int fd = 0; fd < FILE_PER_PROC; fd++) {
-        if(p->filelist[fd] == NULL) {
-            p->filelist[fd] = file;
-            return fd;
-        }
-    }
-
-    return -1;
+    return fdtable_install(myproc()->files, file);
 }
 
 // 打开或创建文件
@@ -84,7 +71,10 @@ uint64 sys_close()
     if(arg_fd(0, &fd, &file) < 0)
         return -1;
 
-    myproc()->filelist[fd] = NULL;
+    // 同一张表的另一个线程可能已经抢先关闭了它
+    file = fdtable_remove(myproc()->files, fd);
+    if(file == NULL)
+        return -1;
     file_close(file);
 
     return 0;
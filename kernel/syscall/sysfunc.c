@@ -1,11 +1,19 @@
 #include "proc/cpu.h"
 #include "proc/proc.h"
+#include "proc/futex.h"
+#include "proc/sched.h"
 #include "mem/vmem.h"
 #include "mem/pmem.h"
+#include "mem/zswap.h"
+#include "mem/ksm.h"
+#include "mem/compact.h"
+#include "dev/timer.h"
+#include "dev/twheel.h"
 //#include "mem/mmap.h"
 //#include "lib/str.h"
 #include "lib/print.h"
 #include "syscall/sysfunc.h"
+#include "riscv.h"
 #include "syscall/syscall.h"
 
 // 堆伸缩
@@ -14,55 +22,65 @@
 uint64 sys_brk()
 {
     proc_t* p = myproc();
-    uint64 new_brk;
+    mm_t* mm = p->mm;
+    uint64 new_brk, ret;
     arg_uint64(0, &new_brk);
 
+    // 同一进程的其他线程可能同时伸缩堆或者缺页
+    mm_lock(mm);
     printf("[sys_brk] proc %d: current heap_top=%p, requested=%p\n",
-           p->pid, p->heap_top, new_brk);
-
-    // 如果参数为0，返回当前堆顶地址
-    if(new_brk == 0) {
-        printf("[sys_brk] proc %d: query mode, returning current heap_top=%p\n",
-               p->pid, p->heap_top);
-        return p->heap_top;
-    }
+           p->pid, mm->heap_top, new_brk);
 
     // 检查新的堆顶地址是否合理
-    uint64 old_heap_top = p->heap_top;
+    uint64 old_heap_top = mm->heap_top;
 
-    if(new_brk > old_heap_top) {
+    if(new_brk == 0) {
+        // 如果参数为0，返回当前堆顶地址
+        printf("[sys_brk] proc %d: query mode, returning current heap_top=%p\n",
+               p->pid, old_heap_top);
+        ret = old_heap_top;
+    } else if(new_brk > old_heap_top) {
+        // 堆不能长进mremap区域
+        if(new_brk > MMAP_BASE) {
+            printf("[sys_brk] proc %d: heap would overlap mremap area\n", p->pid);
+            mm_unlock(mm);
+            return -1;
+        }
         // 堆扩展
         uint64 grow_size = new_brk - old_heap_top;
         printf("[sys_brk] proc %d: expanding heap by %d bytes\n", p->pid, grow_size);
 
-        uint64 new_heap_top = uvm_heap_grow(p->pgtbl, old_heap_top, grow_size);
+        uint64 new_heap_top = uvm_heap_grow(mm->pgtbl, old_heap_top, grow_size);
 
         if(new_heap_top != new_brk) {
             // 扩展失败
             printf("[sys_brk] proc %d: heap expansion failed\n", p->pid);
+            mm_unlock(mm);
             return -1;
         }
 
-        p->heap_top = new_heap_top;
+        mm->heap_top = new_heap_top;
         printf("[sys_brk] proc %d: heap expanded successfully, new_heap_top=%p\n",
                p->pid, new_heap_top);
-        return new_heap_top;
+        ret = new_heap_top;
     } else if(new_brk < old_heap_top) {
         // 堆收缩
         uint64 shrink_size = old_heap_top - new_brk;
         printf("[sys_brk] proc %d: shrinking heap by %d bytes\n", p->pid, shrink_size);
 
-        uint64 new_heap_top = uvm_heap_ungrow(p->pgtbl, old_heap_top, shrink_size);
+        uint64 new_heap_top = uvm_heap_ungrow(mm->pgtbl, old_heap_top, shrink_size);
 
-        p->heap_top = new_heap_top;
+        mm->heap_top = new_heap_top;
         printf("[sys_brk] proc %d: heap shrunk successfully, new_heap_top=%p\n",
                p->pid, new_heap_top);
-        return new_heap_top;
+        ret = new_heap_top;
     } else {
         // 堆顶地址不变
         printf("[sys_brk] proc %d: heap_top unchanged=%p\n", p->pid, old_heap_top);
-        return old_heap_top;
+        ret = old_heap_top;
     }
+    mm_unlock(mm);
+    return ret;
 }
 
 // 内存映射
@@ -162,7 +180,7 @@ uint64 sys_wait()
            myproc()->pid, status_addr);
 
     // 调用内核的 proc_wait 函数
-    int child_pid = proc_wait(status_addr);
+    int child_pid = proc_wait(-1, status_addr, 0);
 
     if (child_pid > 0) {
         printf("[sys_wait] proc %d: child process %d exited\n",
@@ -188,6 +206,9 @@ uint64 sys_exit()
     // 永远不会到达这里
     return 0;
 }
+// 睡眠
+// uint32 seconds 睡眠的秒数
+// 在时间轮上挂一个定时事件, 到期之前进程不参与调度
 uint64 sys_sleep()
 {
     uint32 seconds;
@@ -197,12 +218,7 @@ uint64 sys_sleep()
 
     printf("[sys_sleep] proc %d: sleeping for %d seconds\n", myproc()->pid, seconds);
 
-    // 简化实现：通过调用 proc_yield() 多次来模拟睡眠
-    // 在实际系统中，这里应该使用定时器中断来精确控制睡眠时间
-    for (uint32 i = 0; i < seconds; i++) {
-        // 让出CPU，等待调度
-        proc_yield();
-    }
+    twheel_sleep(NS_TO_TICKS((uint64)seconds * 1000000000ul));
 
     printf("[sys_sleep] proc %d: woke up after sleeping\n", myproc()->pid);
     return 0;
@@ -227,4 +243,318 @@ uint64 sys_fork()
         printf("[sys_fork] proc %d: fork failed\n", myproc()->pid);
         return -1;
     }
-}
\ No newline at end of file
+}
+
+// 查询调用进程映射的2MiB大页数量
+// 返回大页数量
+uint64 sys_huge_count()
+{
+    proc_t* p = myproc();
+    uint32 count = uvm_huge_count(p->pgtbl);
+
+    printf("[sys_huge_count] proc %d: %d huge pages\n", p->pid, count);
+    return count;
+}
+
+// 查询压缩交换缓存的统计信息
+// uint64 addr 存放zswap_stat_t的用户地址(为0时只打印)
+// 返回当前缓存的页面数
+uint64 sys_zswap_stat()
+{
+    proc_t* p = myproc();
+    uint64 addr;
+    zswap_stat_t st;
+
+    arg_uint64(0, &addr);
+    zswap_get_stat(&st);
+
+    // 压缩比以百分比表示: 压缩后大小 / 原始大小
+    uint64 ratio = st.orig_bytes ? st.comp_bytes * 100 / st.orig_bytes : 0;
+    printf("[sys_zswap_stat] stored=%lu rejected=%lu hits=%lu misses=%lu\n",
+           st.stored, st.rejected, st.hits, st.misses);
+    printf("[sys_zswap_stat] entries=%d pool_pages=%d ratio=%lu%%\n",
+           st.entries, st.pool_pages, ratio);
+
+    if(addr != 0)
+        uvm_copyout(p->pgtbl, addr, (uint64)&st, sizeof(st));
+    return st.entries;
+}
+
+// 查询同页合并的统计信息
+// uint64 addr 存放ksm_stat_t的用户地址(为0时只打印)
+// 返回节省的页面数
+uint64 sys_ksm_stat()
+{
+    proc_t* p = myproc();
+    uint64 addr;
+    ksm_stat_t st;
+
+    arg_uint64(0, &addr);
+    ksm_get_stat(&st);
+
+    printf("[sys_ksm_stat] shared=%lu sharing=%lu scanned=%lu full_scans=%lu\n",
+           st.pages_shared, st.pages_sharing, st.pages_scanned, st.full_scans);
+
+    if(addr != 0)
+        uvm_copyout(p->pgtbl, addr, (uint64)&st, sizeof(st));
+    return st.pages_sharing;
+}
+
+// 查询进程的工作集
+// int pid 目标进程(为0表示调用者自己)
+// uint32 n 统计最近n个采样周期(每周期WSS_INTERVAL个tick)
+// uint64 addr 存放wss_t(空闲年龄直方图)的用户地址, 为0时不拷贝
+// 成功返回工作集页面数 失败返回-1
+uint64 sys_wss()
+{
+    proc_t* p = myproc();
+    uint32 pid, n;
+    uint64 addr;
+    wss_t wss;
+
+    arg_uint32(0, &pid);
+    arg_uint32(1, &n);
+    arg_uint64(2, &addr);
+    if(pid == 0)
+        pid = p->pid;
+
+    if(proc_wss(pid, &wss) < 0) {
+        printf("[sys_wss] proc %d: no such process %d\n", p->pid, pid);
+        return -1;
+    }
+    uint32 size = wss_size(&wss, n);
+    printf("[sys_wss] proc %d: wss(%d intervals)=%d pages dirty=%d samples=%d\n",
+           pid, n, size, wss.dirty, wss.samples);
+
+    if(addr != 0)
+        uvm_copyout(p->pgtbl, addr, (uint64)&wss, sizeof(wss));
+    return size;
+}
+
+// 立即规整物理内存, 尝试腾出一个空闲的2MiB对齐块
+// uint64 addr 存放compact_stat_t的用户地址(为0时只打印)
+// 返回规整后的碎片指数(千分制, -1表示已有空闲的对齐块)
+uint64 sys_compact()
+{
+    proc_t* p = myproc();
+    uint64 addr;
+    compact_stat_t st;
+
+    arg_uint64(0, &addr);
+    bool ok = compact_huge();
+    compact_get_stat(&st);
+
+    printf("[sys_compact] %s: frag index %d -> %d, migrated=%d\n",
+           ok ? "ok" : "failed", st.frag_before, st.frag_after, st.migrated);
+
+    if(addr != 0)
+        uvm_copyout(p->pgtbl, addr, (uint64)&st, sizeof(st));
+    return st.frag_after;
+}
+
+// 调整一段已有映射的大小, 必要时把它搬到新的虚拟地址(只改写PTE, 不拷贝页面内容)
+// uint64 old_addr 映射起始地址(page-aligned)
+// uint32 old_len  原长度(字节)
+// uint32 new_len  新长度(字节)
+// uint32 flags    MREMAP_MAYMOVE(1): 无法原地扩展时允许搬迁
+// 映射必须位于mremap区域内, 或者是堆顶的一段(搬走或缩小后堆顶随之下降, 堆中不会留下空洞)
+// 成功返回映射的新地址 失败返回-1
+uint64 sys_mremap()
+{
+    proc_t* p = myproc();
+    uint64 old_addr;
+    uint32 old_len, new_len, flags;
+
+    arg_uint64(0, &old_addr);
+    arg_uint32(1, &old_len);
+    arg_uint32(2, &new_len);
+    arg_uint32(3, &flags);
+
+    uint64 old_size = PG_ROUND_UP((uint64)old_len);
+    uint64 new_size = PG_ROUND_UP((uint64)new_len);
+    uint64 old_end = old_addr + old_size;
+
+    mm_lock(p->mm);
+    bool in_heap = old_end == PG_ROUND_UP(p->mm->heap_top);
+    bool in_mmap = old_addr >= MMAP_BASE && old_end <= MMAP_END;
+    if(old_addr % PGSIZE != 0 || old_size == 0 || new_size == 0 || !(in_heap || in_mmap)) {
+        mm_unlock(p->mm);
+        printf("[sys_mremap] proc %d: invalid range %p + %d\n", p->pid, old_addr, old_len);
+        return -1;
+    }
+
+    uint64 new_addr = uvm_mremap(p->pgtbl, old_addr, old_size, new_size, flags & MREMAP_MAYMOVE);
+    if(new_addr != 0 && in_heap)
+        p->mm->heap_top = (new_addr == old_addr) ? old_addr + new_size : old_addr;
+    mm_unlock(p->mm);
+    if(new_addr == 0) {
+        printf("[sys_mremap] proc %d: mremap %p failed\n", p->pid, old_addr);
+        return -1;
+    }
+    printf("[sys_mremap] proc %d: %p (%d bytes) -> %p (%d bytes)\n",
+           p->pid, old_addr, old_len, new_addr, new_len);
+    return new_addr;
+}
+
+// 调整当前进程的nice值(多级反馈队列中能进入的最高优先级层, 0最高)
+// uint32 inc 增量(按int解释, 可以为负; 0代表查询)
+// 结果限制在[0, MLFQ_LEVELS-1], 返回调整后的nice值
+uint64 sys_nice()
+{
+    proc_t* p = myproc();
+    uint32 inc;
+    arg_uint32(0, &inc);
+
+    int nice = proc_nice((int)inc);
+    printf("[sys_nice] proc %d: nice=%d prio=%d\n", p->pid, nice, p->prio);
+    return nice;
+}
+
+// 创建一个线程, 与调用者共享页表、堆和文件描述符表
+// uint64 stack 新线程的用户栈顶(调用者事先在堆中分配好)
+// 新线程从clone返回处开始执行, 返回值为0; 退出后由调用者wait回收
+// 成功时调用者得到新线程的pid 失败返回-1
+uint64 sys_clone()
+{
+    proc_t* p = myproc();
+    uint64 stack;
+    arg_uint64(0, &stack);
+
+    if(stack == 0 || stack % 16 != 0) {
+        printf("[sys_clone] proc %d: invalid stack %p\n", p->pid, stack);
+        return -1;
+    }
+    int tid = proc_clone(stack);
+    printf("[sys_clone] proc %d: created thread %d\n", p->pid, tid);
+    return tid;
+}
+
+// 用户态锁的慢路径(见proc/futex.h)
+// uint64 uaddr  锁字地址(4字节对齐)
+// uint32 op     FUTEX_WAIT / FUTEX_WAKE / FUTEX_REQUEUE
+// uint32 val    WAIT: 期望的锁字值; WAKE和REQUEUE: 最多唤醒的等待者数
+// uint64 uaddr2 REQUEUE: 转移到的锁字地址
+// uint32 val2   REQUEUE: 最多转移的等待者数
+// WAIT成功被唤醒返回0; WAKE和REQUEUE返回唤醒(和转移)的等待者数; 失败返回-1
+uint64 sys_futex()
+{
+    uint64 uaddr, uaddr2;
+    uint32 op, val, val2;
+
+    arg_uint64(0, &uaddr);
+    arg_uint32(1, &op);
+    arg_uint32(2, &val);
+    arg_uint64(3, &uaddr2);
+    arg_uint32(4, &val2);
+
+    switch(op) {
+        case FUTEX_WAIT:
+            return futex_wait(uaddr, val);
+        case FUTEX_WAKE:
+            return futex_wake(uaddr, val);
+        case FUTEX_REQUEUE:
+            return futex_requeue(uaddr, val, uaddr2, val2);
+        default:
+            printf("[sys_futex] proc %d: unknown op %d\n", myproc()->pid, op);
+            return -1;
+    }
+}
+
+// 设置进程的CPU亲和性
+// uint32 pid  目标进程(0代表当前进程)
+// uint64 mask 第i位为1表示允许在hart i上运行(还没有上线的hart被忽略)
+// 成功返回0 失败返回-1
+uint64 sys_sched_setaffinity()
+{
+    uint32 pid;
+    uint64 mask;
+    arg_uint32(0, &pid);
+    arg_uint64(1, &mask);
+
+    int ret = proc_setaffinity(pid, mask);
+    printf("[sys_sched_setaffinity] proc %d: pid %d mask=%p %s\n",
+           myproc()->pid, pid, mask, ret == 0 ? "ok" : "failed");
+    return ret;
+}
+
+// 查询进程的CPU亲和性
+// uint32 pid 目标进程(0代表当前进程)
+// 成功返回CPU掩码 失败返回-1
+uint64 sys_sched_getaffinity()
+{
+    uint32 pid;
+    uint64 mask;
+    arg_uint32(0, &pid);
+
+    if(proc_getaffinity(pid, &mask) < 0)
+        return -1;
+    return mask;
+}
+
+// 等待指定的子进程退出
+// int32  pid     子进程pid(小于等于0代表任意子进程)
+// uint64 addr    存放退出状态的用户地址(为0时不写回)
+// uint32 options WNOHANG(1): 没有已退出的子进程时立即返回0
+// 成功返回回收的子进程pid; WNOHANG且子进程都还在运行返回0; 没有符合条件的子进程返回-1
+uint64 sys_waitpid()
+{
+    uint32 pid, options;
+    uint64 addr;
+    arg_uint32(0, &pid);
+    arg_uint64(1, &addr);
+    arg_uint32(2, &options);
+
+    int ret = proc_wait((int)pid, addr, options);
+    printf("[sys_waitpid] proc %d: waitpid(%d, %d) = %d\n",
+           myproc()->pid, (int)pid, options, ret);
+    return ret;
+}
+
+// 当前进程加入截止期(EDF)调度, 单位都是时钟tick
+// uint64 runtime  每个周期的运行预算(0代表回到普通调度)
+// uint64 deadline 相对截止期(0代表等于period)
+// uint64 period   周期(不超过SCHED_DL_MAX)
+// 成功返回0; 参数不合法或者准入控制拒绝返回-1
+uint64 sys_sched_setdeadline()
+{
+    uint64 runtime, deadline, period;
+    arg_uint64(0, &runtime);
+    arg_uint64(1, &deadline);
+    arg_uint64(2, &period);
+
+    int ret = proc_setdeadline(runtime, deadline, period);
+    printf("[sys_sched_setdeadline] proc %d: runtime=%d deadline=%d period=%d %s\n",
+           myproc()->pid, runtime, deadline, period, ret == 0 ? "ok" : "rejected");
+    return ret;
+}
+
+// 读取调度统计(结构体定义见proc/schedstat.h)
+// uint32 which SCHEDSTAT_PROC(0): 进程的proc_schedstat_t; SCHEDSTAT_CPU(1): hart的cpu_schedstat_t
+// uint32 id    进程pid(0代表当前进程)或hartid
+// uint64 addr  存放结果的用户地址
+// 成功返回写入的字节数 失败返回-1
+uint64 sys_sched_stats()
+{
+    proc_t* p = myproc();
+    uint32 which, id;
+    uint64 addr;
+    arg_uint32(0, &which);
+    arg_uint32(1, &id);
+    arg_uint64(2, &addr);
+
+    if(which == SCHEDSTAT_PROC) {
+        proc_schedstat_t st;
+        if(proc_schedstat(id, &st) < 0)
+            return -1;
+        uvm_copyout(p->pgtbl, addr, (uint64)&st, sizeof(st));
+        return sizeof(st);
+    }
+    if(which == SCHEDSTAT_CPU) {
+        cpu_schedstat_t st;
+        if(sched_cpustat(id, &st) < 0)
+            return -1;
+        uvm_copyout(p->pgtbl, addr, (uint64)&st, sizeof(st));
+        return sizeof(st);
+    }
+    return -1;
+}
@@ -6,6 +6,7 @@
 #include "trap/trap.h"
 #include "proc/cpu.h"
 #include "proc/proc.h"
+#include "proc/sched.h"
 #include "memlayout.h"
 #include "riscv.h"
 
@@ -106,30 +107,47 @@ void external_interrupt_handler()
 void timer_interrupt_handler()
 {
     // 只有CPU 0更新系统时钟，避免双核重复更新
+    // 优先级提升也由CPU 0按固定周期触发(停掉周期时钟期间可能跨过很多tick)
     if (mycpuid() == 0) {
+        static uint64 last_boost = 0;
         timer_update();
+        uint64 now = timer_get_ticks();
+        if (now - last_boost >= MLFQ_BOOST) {
+            last_boost = now;
+            proc_boost();
+        }
     }
 
-    // 每个核心都输出自己的时钟中断标识
-    int cpuid = mycpuid();
-    printf("t%d\n", cpuid);
+    // 更新本hart的负载, 周期性地从最忙的hart拉进程过来
+    sched_tick();
 
     // 时间片计算：仅更新当前进程的时间片计数
     proc_t* p = myproc();
     if (p != NULL) {
         spinlock_acquire(&p->lk);
         p->total_time++;
-        if (p->time_slice > 0) {
+        if (p->dl_runtime > 0) {
+            // 截止期进程消耗本周期的预算, 用完后返回用户态之前被节流(见sched_preempt)
+            if (p->dl_left > 0)
+                p->dl_left--;
+        } else if (p->time_slice > 0) {
             p->time_slice--;
-            // 显示时间片倒计时（仅在快用完时显示，避免输出过多）
-            if (p->time_slice <= 3) {
-                printf("[TIME] Process %d: %d ticks remaining\n", p->pid, p->time_slice);
-            }
         }
         spinlock_release(&p->lk);
     }
 }
 
+// S-mode软件中断处理
+// M-mode把时钟中断和处理器间中断都转成了S-mode软件中断
+// 处理器间中断只用来唤醒空闲的hart, 除了打断wfi之外不需要做任何事
+void soft_interrupt_handler()
+{
+    // 先清除S-mode软件中断位再取标志, 处理期间新到的时钟中断不会丢失
+    w_sip(r_sip() & ~2);
+    if (timer_tick_pending())
+        timer_interrupt_handler();
+}
+
 // 在kernel_vector()里面调用
 // 内核态trap处理的核心逻辑
 void trap_kernel_handler()
@@ -148,10 +166,8 @@ void trap_kernel_handler()
         // 这是一个中断
         int interrupt_id = scause & 0xf;
         switch (interrupt_id) {
-            case 1: // S-mode软件中断（由M-mode时钟中断触发）
-                timer_interrupt_handler();
-                // 清除S-mode软件中断位
-                w_sip(r_sip() & ~2);
+            case 1: // S-mode软件中断（由M-mode时钟中断或其他hart触发）
+                soft_interrupt_handler();
                 break;
             case 5: // S-mode时钟中断（直接委托的时钟中断）
                 timer_interrupt_handler();
@@ -182,15 +198,12 @@ void trap_kernel_handler()
             proc_t* p = myproc();
             if (p != NULL) {
                 spinlock_acquire(&p->lk);
-                if (p->time_slice == 0) {
-                    // 时间片用完，重置时间片并触发调度
-                    printf("[SCHED-K] Process %d time slice expired in kernel mode, switching...\n", p->pid);
-                    p->time_slice = TIME_SLICE;
-                    p->state = RUNNABLE;
+                if (sched_preempt(p)) {
+                    // 时间片用完(已降级并重置时间片)或有更高优先级的进程，触发调度
+                    // 抢占次数、等待时间等记录在调度统计中(见proc/schedstat.h)
+                    sched_ready(p, mycpuid());
                     proc_sched();
-                    // proc_sched会释放锁并切换到调度器，不会返回到这里
                     // 当进程再次被调度时会从这里继续执行
-                    printf("[SCHED-K] Process %d resumed after kernel scheduling\n", p->pid);
                 }
                 spinlock_release(&p->lk);
             }
@@ -2,8 +2,10 @@
 #include "trap/trap.h"
 #include "proc/cpu.h"
 #include "proc/proc.h"
+#include "proc/sched.h"
 #include "dev/timer.h"
 #include "mem/vmem.h"
+#include "mem/kstack.h"
 #include "memlayout.h"
 #include "riscv.h"
 #include "syscall/syscall.h"
@@ -11,7 +13,6 @@
 // 用户虚拟地址空间的布局常量
 #define VA_MAX (1ul << 38)               // 最大虚拟地址
 #define TRAMPOLINE (VA_MAX - PGSIZE)     // trampoline页的虚拟地址
-#define TRAPFRAME (TRAMPOLINE - PGSIZE)  // trapframe页的虚拟地址
 
 // in trampoline.S
 extern char trampoline[];      // 内核和用户切换的代码
@@ -24,6 +25,7 @@ extern char kernel_vector[];   // 内核态trap处理流程
 // in trap_kernel.c
 extern void external_interrupt_handler();
 extern void timer_interrupt_handler();
+extern void soft_interrupt_handler();
 
 // 异常信息
 static char* exception_info[16] = {
@@ -72,10 +74,8 @@ void trap_user_handler()
         // 这是一个中断
         int interrupt_id = scause & 0xf;
         switch (interrupt_id) {
-            case 1: // S-mode软件中断（由M-mode时钟中断触发）
-                timer_interrupt_handler();
-                // 清除S-mode软件中断位
-                w_sip(r_sip() & ~2);
+            case 1: // S-mode软件中断（由M-mode时钟中断或其他hart触发）
+                soft_interrupt_handler();
                 break;
             case 5: // S-mode时钟中断（直接委托的时钟中断）
                 timer_interrupt_handler();
@@ -100,15 +100,27 @@ void trap_user_handler()
                 syscall();
                 break;
 
+            case 2: // Illegal instruction
+                // 第一次执行浮点指令: 打开浮点单元后重新执行这条指令
+                if(fpu_first_use(p))
+                    break;
+                printf("Exception in user mode: %s (id=%d)\n",
+                       exception_info[exception_id], exception_id);
+                printf("sepc=0x%p stval=0x%p\n", sepc, stval);
+                assert(0, "Unhandled user exception");
+                break;
+
             case 12: // Instruction page fault
             case 13: // Load page fault
             case 15: // Store/AMO page fault
-                // 页面错误处理
+                // 页面被换出或写入了写时复制页面: 修复后返回用户态重新执行该指令
+                if(uvm_fault(p->pgtbl, stval, exception_id == 15))
+                    break;
                 printf("Page fault in user mode: %s (id=%d)\n",
                        exception_info[exception_id], exception_id);
                 printf("sepc=0x%p stval=0x%p\n", sepc, stval);
 
-                assert(0, "Page fault not implemented");
+                assert(0, "Unhandled page fault");
                 break;
 
             default:
@@ -124,17 +136,26 @@ void trap_user_handler()
         }
     }
 
-    // 检查时间片是否用完，如果用完则进行调度
+    // 采样线程采样工作集时本进程有线程正在运行, 由先返回用户态的线程补做采样
+    // 持有mm的睡眠锁, 不会和同一地址空间的其他线程同时改写页表
+    if (p->mm->wss_pending) {
+        mm_lock(p->mm);
+        if (p->mm->wss_pending) {
+            wss_sample(p->pgtbl, &p->mm->wss);
+            p->mm->wss_pending = false;
+            sfence_vma();
+        }
+        mm_unlock(p->mm);
+    }
+
+    // 检查时间片是否用完或有更高优先级的进程在等待，需要时进行调度
     spinlock_acquire(&p->lk);
-    if (p->time_slice == 0) {
-        // 时间片用完，重置时间片并触发调度
-        printf("[SCHED] Process %d time slice expired, switching...\n", p->pid);
-        p->time_slice = TIME_SLICE;
-        p->state = RUNNABLE;
+    if (sched_preempt(p)) {
+        // 时间片用完(已降级并重置时间片)或有更高优先级的进程，触发调度
+        // 抢占次数、等待时间等记录在调度统计中(见proc/schedstat.h)
+        sched_ready(p, mycpuid());
         proc_sched();
-        // proc_sched会释放锁并切换到调度器，不会返回到这里
         // 当进程再次被调度时会从这里继续执行
-        printf("[SCHED] Process %d resumed after scheduling\n", p->pid);
     }
     spinlock_release(&p->lk);
 
@@ -155,15 +176,18 @@ void trap_user_return()
 
     // 设置trapframe的值，这些值将由trampoline.S使用
     p->tf->kernel_satp = r_satp();         // 内核页表
-    p->tf->kernel_sp = p->kstack + PGSIZE; // 进程的内核栈
+    p->tf->kernel_sp = p->kstack + KSTACK_SIZE; // 进程的内核栈
     p->tf->kernel_trap = (uint64)trap_user_handler;
     p->tf->kernel_hartid = r_tp();         // hartid，用于mycpu()
 
     // 设置S-mode中断
     // 我们希望在用户空间接收定时器中断
+    // 浮点单元: 没用过浮点的进程保持关闭, 用过的按需恢复寄存器(见proc/fpu.h)
+    uint64 fs = fpu_user_return(p);
     unsigned long x = r_sstatus();
     x &= ~SSTATUS_SPP; // 清除SPP位以返回用户模式
     x |= SSTATUS_SPIE; // 在用户模式下启用中断
+    x = (x & ~SSTATUS_FS) | fs;
     w_sstatus(x);
 
     // 设置S-mode异常程序计数器为保存的用户pc
@@ -173,5 +197,6 @@ void trap_user_return()
     uint64 satp = MAKE_SATP(p->pgtbl);
 
     void (*fn)(uint64, uint64) = (void(*)(uint64, uint64))(TRAMPOLINE + (user_return - trampoline));
-    fn(TRAPFRAME, satp);
+    // 每个线程的trapframe映射在共享页表中的不同地址(见proc_clone)
+    fn(p->tf_va, satp);
 }
\ No newline at end of file
@@ -5,7 +5,7 @@
 #include <fcntl.h>
 #include <assert.h>
 
-// disk layout: [ super block | inode bitmap | inode blocks | data bitmap | data blocks ]
+// disk layout: [ super block | inode bitmap | inode blocks | data bitmap | data blocks | swap blocks ]
 
 #define FS_MAGIC 0x12345678
 
@@ -22,6 +22,9 @@ typedef struct super_block {
     unsigned int inode_blocks;
     unsigned int data_blocks;
     unsigned int total_blocks;
+
+    unsigned int swap_start;
+    unsigned int swap_blocks;
 } super_block_t;
 
 // inode 64 byte
@@ -50,7 +53,8 @@ typedef struct dirent {
 #define BLOCK_SIZE       1024 // 每个block占1024字节
 #define N_DATA_BLOCK     8192 // 1个block的bitmap管理的极限
 #define N_INODE_BLOCK    128  // 支持2048个文件
-#define N_BLOCK          (N_DATA_BLOCK + N_INODE_BLOCK + 3)  // 五个部分组合起来
+#define N_SWAP_BLOCK     16384 // 交换区16MB, 可以容纳4096个换出的页面
+#define N_BLOCK          (N_DATA_BLOCK + N_INODE_BLOCK + 3 + N_SWAP_BLOCK)  // 六个部分组合起来
 #define INODE_PER_BLOCK  (BLOCK_SIZE / sizeof(inode_disk_t)) // 每个block里的inode数量
 #define N_INODE          (N_INODE_BLOCK * INODE_PER_BLOCK)   // inode总数
 
@@ -301,6 +305,8 @@ int main(int argc, char* argv[])
     sb.inode_start = xint(1 + 1);
     sb.data_bitmap_start = xint(1 + 1 + N_INODE_BLOCK);
     sb.data_start = xint(1 + 1 + N_INODE_BLOCK + 1);
+    sb.swap_start = xint(1 + 1 + N_INODE_BLOCK + 1 + N_DATA_BLOCK);
+    sb.swap_blocks = xint(N_SWAP_BLOCK);
 
     // 缓冲区准备
     char buf[BLOCK_SIZE];